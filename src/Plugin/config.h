@@ -1,34 +1,337 @@
 #pragma once
 
+#include "Shared/Ini.h"
+#include <cstdint>
 #include <string>
-#include <windows.h>
+#include <vector>
+
+//
+// Settings of plugin.ini, every one is declared once here:
+// X(type, name, section, key, default, min, max)
+//
+// min and max limit int values only. Other types are parsed by LoadValue
+// overloads below: bool, uint32_t address (0 if not set), std::string and a
+// list of addresses separated with commas or spaces.
+//
+// Config file example:
+// [Example]
+// PK = 1
+// StartZone = gz12k
+//
+// [Trace]
+// File = hooks.trace
+//
+// [Latency]
+// Functions = 0x4A5D00, 0x554100
+// Report = latency.txt
+//
+// [Heap]
+// Pool = 1
+// PoolSize = 64
+// Malloc = 0x5A1B20
+// Free = 0x5A1C40
+// Realloc = 0x5A1D10
+// Msize = 0x5A1E00
+// Expand = 0x5A1F30
+// Recalloc = 0x5A2010
+// FreeBase = 0x5A2100
+// Profile = heap.txt
+// ProfileInterval = 10
+// ProfileSampleRate = 64
+// ProfileTop = 30
+//
+// [FramePacer]
+// Enable = 1
+// Fps = 60
+// Calls = 0x4A61F2
+// Report = frames.txt
+//
+// [Config]
+// HotReload = 1
+//
+// [Startup]
+// Report = startup.txt
+//
+// [Patches]
+// Image = plugin.patches
+//
+
+// clang-format off
+#define PLUGIN_SETTINGS(X)                                                                    \
+    X(bool,                  EnablePK,           "Example", "PK",                false,  0, 0) \
+    X(std::string,           StartZoneName,      "Example", "StartZone",         "",     0, 0) \
+    X(std::string,           TraceFile,          "Trace",   "File",              "",     0, 0) \
+    X(std::vector<uint32_t>, LatencyFunctions,   "Latency", "Functions",         {},     0, 0) \
+    X(std::string,           LatencyReport,      "Latency", "Report",            "latency.txt", 0, 0) \
+    X(bool,                  EnableHeapPool,     "Heap",    "Pool",              false,  0, 0) \
+    X(int,                   HeapPoolSizeMb,     "Heap",    "PoolSize",          64,     1, 2047) \
+    X(uint32_t,              MallocAddr,         "Heap",    "Malloc",            0,      0, 0) \
+    X(uint32_t,              FreeAddr,           "Heap",    "Free",              0,      0, 0) \
+    X(uint32_t,              ReallocAddr,        "Heap",    "Realloc",           0,      0, 0) \
+    X(uint32_t,              MsizeAddr,          "Heap",    "Msize",             0,      0, 0) \
+    X(uint32_t,              ExpandAddr,         "Heap",    "Expand",            0,      0, 0) \
+    X(uint32_t,              RecallocAddr,       "Heap",    "Recalloc",          0,      0, 0) \
+    X(uint32_t,              FreeBaseAddr,       "Heap",    "FreeBase",          0,      0, 0) \
+    X(std::string,           HeapProfReport,     "Heap",    "Profile",           "",     0, 0) \
+    X(int,                   HeapProfInterval,   "Heap",    "ProfileInterval",   10,     0, 86400) \
+    X(int,                   HeapProfSampleRate, "Heap",    "ProfileSampleRate", 64,     1, 1048576) \
+    X(int,                   HeapProfTop,        "Heap",    "ProfileTop",        30,     0, 10000) \
+    X(bool,                  EnableFramePacer,   "FramePacer", "Enable",         false,  0, 0) \
+    X(int,                   FramePacerFps,      "FramePacer", "Fps",            60,     1, 1000) \
+    X(std::vector<uint32_t>, FramePacerCalls,    "FramePacer", "Calls",          {},     0, 0) \
+    X(std::string,           FramePacerReport,   "FramePacer", "Report",         "",     0, 0) \
+    X(bool,                  HotReload,          "Config",  "HotReload",         false,  0, 0) \
+    X(std::string,           StartupReport,      "Startup", "Report",            "",     0, 0) \
+    X(std::string,           PatchImageFile,     "Patches", "Image",             "",     0, 0)
+// clang-format on
+
+namespace Config {
+
+enum ESetting
+{
+#define _CONFIG_INDEX(type, name, section, key, def, min, max) SI_##name,
+    PLUGIN_SETTINGS(_CONFIG_INDEX)
+#undef _CONFIG_INDEX
+    SI_COUNT
+};
+
+struct SSettingDesc
+{
+    const char *Section;
+    const char *Key;
+    const char *Type;
+    uint32_t Hash;
+};
+
+constexpr SSettingDesc Settings[] = {
+#define _CONFIG_DESC(type, name, section, key, def, min, max) \
+    {section, key, #type, Ini::HashKey(section, key)},
+    PLUGIN_SETTINGS(_CONFIG_DESC)
+#undef _CONFIG_DESC
+};
+
+// Hashes of all settings differ, so a key is found by its hash from CIniFile
+constexpr bool IsHashUnique(size_t i, size_t j)
+{
+    return j == SI_COUNT || (Settings[i].Hash != Settings[j].Hash && IsHashUnique(i, j + 1));
+}
+
+constexpr bool AreHashesUnique(size_t i = 0)
+{
+    return i == SI_COUNT || (IsHashUnique(i, i + 1) && AreHashesUnique(i + 1));
+}
+
+static_assert(AreHashesUnique(), "A setting is declared twice or hashes of settings collide");
+
+// Returns SI_COUNT for an unknown key
+static inline size_t FindSetting(const Ini::CIniFile::SEntry &entry)
+{
+    for (size_t i = 0; i < SI_COUNT; i++)
+    {
+        if (Settings[i].Hash == entry.Hash)
+        {
+            // Names are still compared, an unknown key may have the same hash
+            bool same = Ini::EqualNoCase(entry.Section, Settings[i].Section) &&
+                        Ini::EqualNoCase(entry.Key, Settings[i].Key);
+            return same ? i : (size_t)SI_COUNT;
+        }
+    }
+    return SI_COUNT;
+}
+
+// Int and bool keys which the plugin used to read with GetPrivateProfileInt keep its parsing, so
+// existing configs load as before: leading digits are taken and any nonzero number is true.
+// Values of newer keys must match whole
+constexpr ESetting LegacySettings[] = {SI_EnablePK,         SI_EnableHeapPool,    SI_HeapPoolSizeMb,
+                                       SI_HeapProfInterval, SI_HeapProfSampleRate, SI_HeapProfTop,
+                                       SI_HotReload};
+
+constexpr bool IsLegacySetting(size_t index, size_t i = 0)
+{
+    return i != sizeof(LegacySettings) / sizeof(LegacySettings[0]) &&
+           (LegacySettings[i] == index || IsLegacySetting(index, i + 1));
+}
+
+// Loaders of setting types. They return false and leave the result unchanged if the value has a
+// wrong format or is out of range
+static inline bool LoadValue(const Ini::SStringRef &value, int min, int max, int &result)
+{
+    int number;
+    if (!Ini::ParseInt(value, &number) || number < min || number > max)
+        return false;
+    result = number;
+    return true;
+}
+
+static inline bool LoadValue(const Ini::SStringRef &value, int, int, bool &result)
+{
+    return Ini::ParseBool(value, &result);
+}
+
+// Decimal or hexadecimal (0x...) address, an empty value means it isn't set
+static inline bool LoadValue(const Ini::SStringRef &value, int, int, uint32_t &result)
+{
+    if (value.Size != 0)
+        return Ini::ParseUInt(value, &result);
+    result = 0;
+    return true;
+}
+
+static inline bool LoadValue(const Ini::SStringRef &value, int, int, std::string &result)
+{
+    result.assign(value.Data, value.Size);
+    return true;
+}
+
+// Addresses separated with commas or spaces
+static inline bool LoadValue(const Ini::SStringRef &value, int, int, std::vector<uint32_t> &result)
+{
+    std::vector<uint32_t> list;
+    const char *p = value.Data;
+    const char *end = p + value.Size;
+    while (p < end)
+    {
+        if (*p == ',' || *p == ' ' || *p == '\t')
+        {
+            p++; // Skip separator
+            continue;
+        }
+        Ini::SStringRef token = {p, 0};
+        while (p < end && *p != ',' && *p != ' ' && *p != '\t')
+            p++;
+        token.Size = (size_t)(p - token.Data);
+
+        uint32_t addr;
+        if (!Ini::ParseUInt(token, &addr))
+            return false;
+        list.push_back(addr);
+    }
+    result.swap(list);
+    return true;
+}
+
+static inline bool LoadLegacyValue(const Ini::SStringRef &value, int min, int max, int &result)
+{
+    int number = Ini::ParseIntPrefix(value);
+    if (number < min || number > max)
+        return false;
+    result = number;
+    return true;
+}
+
+static inline bool LoadLegacyValue(const Ini::SStringRef &value, int, int, bool &result)
+{
+    result = Ini::ParseIntPrefix(value) != 0;
+    return true;
+}
+
+// Other types have no legacy parsing
+template <class T>
+static inline bool LoadLegacyValue(const Ini::SStringRef &value, int min, int max, T &result)
+{
+    return LoadValue(value, min, max, result);
+}
+
+// Hashes of values for SPluginConfig::GetHash
+static inline uint32_t HashValue(const void *data, size_t size, uint32_t hash)
+{
+    for (size_t i = 0; i < size; i++)
+        hash = Ini::HashByte(hash, ((const uint8_t *)data)[i]);
+    return hash;
+}
+
+static inline uint32_t HashValue(int value, uint32_t hash)
+{
+    return HashValue(&value, sizeof(value), hash);
+}
+
+static inline uint32_t HashValue(bool value, uint32_t hash)
+{
+    return Ini::HashByte(hash, value ? 1 : 0);
+}
+
+static inline uint32_t HashValue(uint32_t value, uint32_t hash)
+{
+    return HashValue(&value, sizeof(value), hash);
+}
+
+// Sizes are hashed too, so values "a" + "bc" and "ab" + "c" differ
+static inline uint32_t HashValue(const std::string &value, uint32_t hash)
+{
+    return HashValue(value.data(), value.size(), HashValue((uint32_t)value.size(), hash));
+}
+
+static inline uint32_t HashValue(const std::vector<uint32_t> &value, uint32_t hash)
+{
+    hash = HashValue((uint32_t)value.size(), hash);
+    return value.empty() ? hash : HashValue(&value[0], value.size() * sizeof(uint32_t), hash);
+}
+
+} // namespace Config
 
 struct SPluginConfig
 {
-    int EnablePK;
-    std::string StartZoneName;
+#define _CONFIG_DECLARE(type, name, section, key, def, min, max) type name;
+    PLUGIN_SETTINGS(_CONFIG_DECLARE)
+#undef _CONFIG_DECLARE
+
+    // Unknown keys and invalid values found by Load
+    std::vector<std::string> Warnings;
 
     SPluginConfig()
-        : EnablePK(0)
-        , StartZoneName("")
     {
+#define _CONFIG_DEFAULT(type, name, section, key, def, min, max) name = def;
+        PLUGIN_SETTINGS(_CONFIG_DEFAULT)
+#undef _CONFIG_DEFAULT
     }
 
     void Load(const std::string &configPath)
     {
-        //
-        // Config file example:
-        // [Example]
-        // PK = 1
-        // StartZoneName = gz12k
-        //
-
-        EnablePK = GetPrivateProfileIntA("Example", "PK", EnablePK, configPath.c_str());
-
-        char buf[1024];
-        GetPrivateProfileStringA("Example", "StartZone", StartZoneName.c_str(), buf, sizeof(buf),
-                                 configPath.c_str());
-        StartZoneName = buf;
+        // The file is read once, GetPrivateProfile* functions would reopen it for every key
+        Ini::CIniFile ini;
+        ini.Load(configPath.c_str());
+
+        for (size_t i = 0; i < ini.GetKeyCount(); i++)
+        {
+            const auto &entry = ini.GetEntry(i);
+            size_t index = Config::FindSetting(entry);
+            if (index == Config::SI_COUNT)
+                AddWarning("Unknown key", entry);
+            else if (!LoadSetting(index, entry.Value))
+                AddWarning("Invalid value of", entry);
+        }
+    }
+
+    // Hash of all values, a patch image is built for one config
+    uint32_t GetHash() const
+    {
+        uint32_t hash = Ini::FnvOffset;
+#define _CONFIG_HASH(type, name, section, key, def, min, max) hash = Config::HashValue(name, hash);
+        PLUGIN_SETTINGS(_CONFIG_HASH)
+#undef _CONFIG_HASH
+        return hash;
+    }
+
+private:
+    bool LoadSetting(size_t index, const Ini::SStringRef &value)
+    {
+        switch (index)
+        {
+#define _CONFIG_LOAD(type, name, section, key, def, min, max)     \
+    case Config::SI_##name:                                       \
+        if (Config::IsLegacySetting(Config::SI_##name))           \
+            return Config::LoadLegacyValue(value, min, max, name); \
+        return Config::LoadValue(value, min, max, name);
+            PLUGIN_SETTINGS(_CONFIG_LOAD)
+#undef _CONFIG_LOAD
+        }
+        return false;
+    }
+
+    void AddWarning(const char *text, const Ini::CIniFile::SEntry &entry)
+    {
+        Warnings.push_back(std::string(text) + " [" + entry.Section.ToString() + "] " +
+                           entry.Key.ToString());
     }
 };
 
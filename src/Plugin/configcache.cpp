@@ -0,0 +1,230 @@
+#include "configcache.h"
+#include "config.h"
+#include "Shared/Common.h"
+#include <windows.h>
+
+namespace {
+
+const uint32_t CacheMagic = 0x47464350; // "PCFG"
+// Changed with the parsing of values by LoadValue and LoadLegacyValue, which the schema hash
+// doesn't see. 2: legacy values are parsed like GetPrivateProfileInt does
+const uint32_t CacheVersion = 2;
+
+struct SCacheHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t SchemaHash; // Names, types, defaults and limits of all settings
+    uint32_t SettingCount;
+    uint64_t IniSize;
+    uint64_t IniWriteTime;
+    uint32_t DataSize; // Bytes after the slots
+    uint32_t Reserved;
+};
+
+// One per setting in the order of PLUGIN_SETTINGS. Numbers are stored in
+// Value, strings and lists are stored in the data area at offset Value
+struct SCacheSlot
+{
+    uint32_t Value;
+    uint32_t Size;
+};
+
+struct SFileStamp
+{
+    uint64_t Size;
+    uint64_t WriteTime;
+};
+
+bool GetFileStamp(const std::wstring &path, SFileStamp &stamp)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &data))
+        return false;
+    stamp.Size = (uint64_t)data.nFileSizeHigh << 32 | data.nFileSizeLow;
+    stamp.WriteTime = (uint64_t)data.ftLastWriteTime.dwHighDateTime << 32 |
+                      data.ftLastWriteTime.dwLowDateTime;
+    return true;
+}
+
+// A snapshot of another plugin build with different settings isn't used. Defaults and limits
+// are hashed too, a build which changes them parses plugin.ini differently
+uint32_t GetSchemaHash()
+{
+    uint32_t hash = Ini::FnvOffset;
+    for (size_t i = 0; i < Config::SI_COUNT; i++)
+    {
+        const Config::SSettingDesc &desc = Config::Settings[i];
+        hash = Ini::HashName(desc.Type, Ini::HashName(desc.Key, Ini::HashName(desc.Section, hash)));
+        hash = Config::HashValue(Config::IsLegacySetting(i), hash);
+    }
+#define _CONFIG_LIMITS(type, name, section, key, def, min, max) \
+    hash = Config::HashValue((int)(max), Config::HashValue((int)(min), hash));
+    PLUGIN_SETTINGS(_CONFIG_LIMITS)
+#undef _CONFIG_LIMITS
+    return Config::HashValue(SPluginConfig().GetHash(), hash);
+}
+
+void StoreValue(int value, SCacheSlot &slot, std::vector<uint8_t> &)
+{
+    slot.Value = (uint32_t)value;
+}
+
+void StoreValue(bool value, SCacheSlot &slot, std::vector<uint8_t> &)
+{
+    slot.Value = value ? 1 : 0;
+}
+
+void StoreValue(uint32_t value, SCacheSlot &slot, std::vector<uint8_t> &)
+{
+    slot.Value = value;
+}
+
+void StoreValue(const std::string &value, SCacheSlot &slot, std::vector<uint8_t> &data)
+{
+    slot.Value = (uint32_t)data.size();
+    slot.Size = (uint32_t)value.size();
+    data.insert(data.end(), value.begin(), value.end());
+}
+
+void StoreValue(const std::vector<uint32_t> &value, SCacheSlot &slot, std::vector<uint8_t> &data)
+{
+    slot.Value = (uint32_t)data.size();
+    slot.Size = (uint32_t)(value.size() * sizeof(uint32_t));
+    if (!value.empty())
+    {
+        auto bytes = (const uint8_t *)&value[0];
+        data.insert(data.end(), bytes, bytes + slot.Size);
+    }
+}
+
+// Numbers are stored in the slot itself. Strings and lists must be inside the data area
+bool ReadValue(const SCacheSlot &slot, const uint8_t *, uint32_t, int &value)
+{
+    value = (int)slot.Value;
+    return true;
+}
+
+bool ReadValue(const SCacheSlot &slot, const uint8_t *, uint32_t, bool &value)
+{
+    value = slot.Value != 0;
+    return true;
+}
+
+bool ReadValue(const SCacheSlot &slot, const uint8_t *, uint32_t, uint32_t &value)
+{
+    value = slot.Value;
+    return true;
+}
+
+bool IsInData(const SCacheSlot &slot, uint32_t dataSize)
+{
+    return slot.Size <= dataSize && slot.Value <= dataSize - slot.Size;
+}
+
+bool ReadValue(const SCacheSlot &slot, const uint8_t *data, uint32_t dataSize, std::string &value)
+{
+    if (!IsInData(slot, dataSize))
+        return false;
+    value.assign((const char *)data + slot.Value, slot.Size);
+    return true;
+}
+
+bool ReadValue(const SCacheSlot &slot, const uint8_t *data, uint32_t dataSize,
+               std::vector<uint32_t> &value)
+{
+    if (!IsInData(slot, dataSize) || slot.Size % sizeof(uint32_t) != 0)
+        return false;
+    value.resize(slot.Size / sizeof(uint32_t));
+    if (!value.empty())
+        memcpy(&value[0], data + slot.Value, value.size() * sizeof(uint32_t));
+    return true;
+}
+
+bool ParseCache(const uint8_t *blob, size_t size, const SFileStamp &stamp, SPluginConfig &config)
+{
+    auto header = (const SCacheHeader *)blob;
+    auto slots = (const SCacheSlot *)(header + 1);
+    const size_t slotsSize = sizeof(SCacheSlot) * Config::SI_COUNT;
+    if (size < sizeof(SCacheHeader) + slotsSize || header->Magic != CacheMagic ||
+        header->Version != CacheVersion || header->SchemaHash != GetSchemaHash() ||
+        header->SettingCount != Config::SI_COUNT || header->IniSize != stamp.Size ||
+        header->IniWriteTime != stamp.WriteTime ||
+        header->DataSize != size - sizeof(SCacheHeader) - slotsSize)
+    {
+        return false;
+    }
+
+    const uint8_t *data = (const uint8_t *)(slots + Config::SI_COUNT);
+#define _CONFIG_READ(type, name, section, key, def, min, max)                     \
+    if (!ReadValue(slots[Config::SI_##name], data, header->DataSize, config.name)) \
+        return false;
+    PLUGIN_SETTINGS(_CONFIG_READ)
+#undef _CONFIG_READ
+    return true;
+}
+
+bool LoadCache(const std::wstring &cachePath, const SFileStamp &stamp, SPluginConfig &config)
+{
+    size_t size;
+    const void *view = Common::MapFileForRead(cachePath, size);
+    if (view == nullptr)
+        return false;
+    bool result = ParseCache((const uint8_t *)view, size, stamp, config);
+    Common::UnmapFile(view);
+    return result;
+}
+
+// The snapshot is written to a temporary file and renamed, so another process never sees a
+// partially written one
+void SaveCache(const std::wstring &cachePath, const SFileStamp &stamp,
+               const SPluginConfig &config)
+{
+    SCacheSlot slots[Config::SI_COUNT] = {};
+    std::vector<uint8_t> data;
+#define _CONFIG_STORE(type, name, section, key, def, min, max) \
+    StoreValue(config.name, slots[Config::SI_##name], data);
+    PLUGIN_SETTINGS(_CONFIG_STORE)
+#undef _CONFIG_STORE
+
+    SCacheHeader header = {};
+    header.Magic = CacheMagic;
+    header.Version = CacheVersion;
+    header.SchemaHash = GetSchemaHash();
+    header.SettingCount = Config::SI_COUNT;
+    header.IniSize = stamp.Size;
+    header.IniWriteTime = stamp.WriteTime;
+    header.DataSize = (uint32_t)data.size();
+
+    std::vector<uint8_t> blob((const uint8_t *)&header, (const uint8_t *)(&header + 1));
+    blob.insert(blob.end(), (const uint8_t *)slots, (const uint8_t *)(slots + Config::SI_COUNT));
+    blob.insert(blob.end(), data.begin(), data.end());
+
+    std::wstring tempPath = cachePath + L".tmp";
+    if (!Common::WriteFileFull(tempPath, &blob[0], blob.size()) ||
+        !MoveFileExW(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING))
+    {
+        DeleteFileW(tempPath.c_str());
+    }
+}
+
+} // namespace
+
+void LoadConfig(SPluginConfig &config, const std::wstring &iniPath)
+{
+    // The stamp is taken before parsing, so a change during it makes the snapshot stale
+    std::wstring cachePath = iniPath + L".bin";
+    SFileStamp stamp;
+    bool hasStamp = GetFileStamp(iniPath, stamp);
+
+    SPluginConfig cached;
+    if (hasStamp && LoadCache(cachePath, stamp, cached))
+    {
+        config = cached;
+        return;
+    }
+
+    config.Load(Common::WideToAnsi(iniPath));
+    if (hasStamp && config.Warnings.empty())
+        SaveCache(cachePath, stamp, config);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <string>
+
+struct SPluginConfig;
+
+//
+// Binary snapshot of plugin.ini.
+//
+// Parsed settings are saved to plugin.ini.bin stamped with the size and the
+// modification time of plugin.ini. While they match, the snapshot is mapped
+// and the settings are copied out of it without parsing. Otherwise the INI is
+// parsed and the snapshot is rewritten. It isn't written if the INI has
+// errors, so they are reported on every start.
+//
+
+void LoadConfig(SPluginConfig &config, const std::wstring &iniPath);
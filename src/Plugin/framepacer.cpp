@@ -0,0 +1,234 @@
+#include "framepacer.h"
+#include "config.h"
+#include "patches.h"
+#include "tracehooks.h"
+#include "Shared/Common.h"
+#include "Shared/Histogram.h"
+#include "Shared/StaticHook.h"
+#include "Shared/Trace.h"
+#include <windows.h>
+
+using namespace Common;
+
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+
+typedef HANDLE(WINAPI *CreateWaitableTimerExWPtr)(LPSECURITY_ATTRIBUTES attributes, LPCWSTR name,
+                                                   DWORD flags, DWORD access);
+typedef UINT(WINAPI *TimePeriodPtr)(UINT period);
+
+static HANDLE Timer = NULL;
+static int64_t QpcFreq;
+static int64_t TimerSlack;        // The timer may fire late by this much, it's spun
+static volatile LONG PeriodTicks; // Changed on reload
+static volatile LONG TargetFps;   // For the report, PluginConfig is changed by the reload
+static int64_t Deadline;          // Of the current frame
+static int64_t FrameStart;
+static Stats::SAtomicHistogram FrameTimes; // Microseconds
+static Stats::SAtomicHistogram WaitTimes;  // Microseconds
+
+// Set if the timer isn't high resolution, the system timer period is then 1 ms while the
+// calls are hooked
+static TimePeriodPtr TimeBeginPeriod = nullptr;
+static TimePeriodPtr TimeEndPeriod = nullptr;
+static bool PeriodRaised = false;
+
+static int64_t Now()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+static uint64_t ToUs(int64_t ticks)
+{
+    return (uint64_t)(ticks * 1000000 / QpcFreq);
+}
+
+static bool CreateTimer()
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    QpcFreq = freq.QuadPart;
+
+    // High resolution timers appeared in Windows 10 1803, the function itself in Vista
+    auto createTimerEx = (CreateWaitableTimerExWPtr)GetProcAddress(
+        GetModuleHandleW(L"kernel32.dll"), "CreateWaitableTimerExW");
+    if (createTimerEx != nullptr)
+    {
+        Timer = createTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+        if (Timer != NULL)
+            return true;
+    }
+
+    // Other timers fire on ticks of the system timer, they are made 1 ms long
+    HMODULE winmm = LoadLibraryW(L"winmm.dll");
+    if (winmm != NULL)
+    {
+        TimeBeginPeriod = (TimePeriodPtr)GetProcAddress(winmm, "timeBeginPeriod");
+        TimeEndPeriod = (TimePeriodPtr)GetProcAddress(winmm, "timeEndPeriod");
+    }
+    TimerSlack = QpcFreq / 1000;
+    Timer = CreateWaitableTimerW(NULL, FALSE, NULL);
+    return Timer != NULL;
+}
+
+// The period is global for the system, every raise is paired with a restore
+static void RaiseTimerPeriod()
+{
+    if (!PeriodRaised && TimeBeginPeriod != nullptr && TimeEndPeriod != nullptr)
+        PeriodRaised = TimeBeginPeriod(1) == 0; // TIMERR_NOERROR
+}
+
+static void RestoreTimerPeriod()
+{
+    if (PeriodRaised)
+        TimeEndPeriod(1);
+    PeriodRaised = false;
+}
+
+static void SetFps(int fps)
+{
+    InterlockedExchange(&PeriodTicks, (LONG)(QpcFreq / fps));
+    InterlockedExchange(&TargetFps, fps);
+}
+
+static void WaitUntil(int64_t deadline)
+{
+    int64_t left = deadline - Now() - TimerSlack;
+    if (left > 0)
+    {
+        LARGE_INTEGER dueTime;
+        dueTime.QuadPart = -(left * 10000000 / QpcFreq); // Relative, in 100 ns units
+        if (SetWaitableTimer(Timer, &dueTime, 0, NULL, NULL, FALSE))
+            WaitForSingleObject(Timer, INFINITE);
+    }
+    while (Now() < deadline)
+        YieldProcessor();
+}
+
+// Replaces Sleep calls of the main loop, the game's delay is ignored
+static void __stdcall PacerSleep(DWORD)
+{
+    Trace::Enter(TH_FRAME_PACER);
+    int64_t start = Now();
+    Deadline += PeriodTicks;
+    if (Deadline < start)
+        Deadline = start; // The frame is late, a new schedule starts
+    WaitUntil(Deadline);
+
+    int64_t end = Now();
+    if (FrameStart != 0)
+        FrameTimes.Record(ToUs(end - FrameStart));
+    WaitTimes.Record(ToUs(end - start));
+    FrameStart = end;
+    Trace::Exit(TH_FRAME_PACER);
+}
+
+static bool PacerEnabled(const SPluginConfig &config)
+{
+    return config.EnableFramePacer;
+}
+
+static bool Reloaded = false;
+
+// Errors stop the game at startup. On reload the patch is left disabled and they are reported
+// as warnings of the reloaded config are
+static bool PacerError(const char *text)
+{
+    if (!Reloaded)
+        ErrorMsgBox(1, "%s", text);
+    OutputDebugStringA(("plugin.ini: " + std::string(text) + "\n").c_str());
+    return false;
+}
+
+static bool PacerPatch(Patcher::SPatch &patch)
+{
+    const auto &calls = PluginConfig.FramePacerCalls;
+    if (calls.empty())
+        return PacerError("Addresses of the game's Sleep calls must be set in [FramePacer]");
+    if (Timer == NULL && !CreateTimer())
+        return PacerError("Cannot create the frame pacer timer");
+    RaiseTimerPeriod();
+    SetFps(PluginConfig.FramePacerFps);
+    Trace::SetHookName(TH_FRAME_PACER, "Sleep");
+
+    // The calls jump straight to PacerSleep, it's stdcall as Sleep is
+    for (size_t i = 0; i < calls.size(); i++)
+    {
+        if (!CREATE_STATIC_FUNC_CALL_HOOK((void *)calls[i], CC_STDCALL, PacerSleep, patch))
+        {
+            char text[64];
+            sprintf_s(text, "Cannot hook Sleep call at 0x%X", calls[i]);
+            return PacerError(text);
+        }
+    }
+    return true;
+}
+
+// Only a change of the calls reapplies the patch
+static bool PacerReload(const SPluginConfig &config)
+{
+    Reloaded = true;
+    auto &cfg = PluginConfig;
+    cfg.FramePacerFps = config.FramePacerFps;
+    if (Timer != NULL)
+        SetFps(cfg.FramePacerFps);
+
+    if (cfg.EnableFramePacer == config.EnableFramePacer &&
+        cfg.FramePacerCalls == config.FramePacerCalls)
+    {
+        return false;
+    }
+    cfg.EnableFramePacer = config.EnableFramePacer;
+    cfg.FramePacerCalls = config.FramePacerCalls;
+    return true;
+}
+
+// The calls are restored, so the pacer doesn't wait anymore
+static void PacerRemove()
+{
+    RestoreTimerPeriod();
+}
+
+REGISTER_PATCH(FramePacer, PacerEnabled, PacerPatch, PacerReload, {}, {}, false, PacerRemove);
+
+void FramePacerStop()
+{
+    RestoreTimerPeriod();
+}
+
+void WriteFramePacerReport(const std::wstring &filename)
+{
+    Stats::SHistogram frames, waits;
+    FrameTimes.Snapshot(frames);
+    WaitTimes.Snapshot(waits);
+    if (frames.Count == 0)
+        return;
+
+    std::string report;
+    char line[256];
+    double meanFps = 1e6 / frames.GetMean();
+    double idle = frames.Sum != 0 ? 100.0 * waits.Sum / frames.Sum : 0.0;
+    sprintf_s(line, "Frames: %llu, target: %d fps, mean: %.1f fps, waiting: %.1f%%\r\n\r\n",
+              (unsigned long long)frames.Count, (int)TargetFps, meanFps, idle);
+    report += line;
+    sprintf_s(line, "%-6s %10s %10s %10s %10s %10s %10s (us)\r\n", "", "Mean", "Min", "p50", "p90",
+              "p99", "Max");
+    report += line;
+
+    const Stats::SHistogram *histograms[] = {&frames, &waits};
+    const char *names[] = {"Frame", "Wait"};
+    for (size_t i = 0; i < _countof(histograms); i++)
+    {
+        const Stats::SHistogram &h = *histograms[i];
+        sprintf_s(line, "%-6s %10.0f %10llu %10llu %10llu %10llu %10llu\r\n", names[i],
+                  h.GetMean(), (unsigned long long)h.Min, (unsigned long long)h.GetPercentile(50),
+                  (unsigned long long)h.GetPercentile(90), (unsigned long long)h.GetPercentile(99),
+                  (unsigned long long)h.Max);
+        report += line;
+    }
+
+    WriteFileFull(filename, report);
+}
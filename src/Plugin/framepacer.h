@@ -0,0 +1,22 @@
+#pragma once
+
+#include <string>
+
+//
+// Frame pacer replacing Sleep calls of the game's main loop.
+//
+// Calls listed in [FramePacer] section of config are hooked by FramePacer
+// patch. Every call ends a frame: it waits on a high resolution waitable timer
+// until the frame target, so the game neither oversleeps by the coarse system
+// timer nor spins. A frame which took longer than the target starts a new
+// schedule, so late frames aren't followed by a burst of short ones.
+//
+// The calls must be made by one thread. Fps is applied on reload without
+// reapplying the patch.
+//
+
+// Restores the system timer period raised for the pacer, called at detach
+void FramePacerStop();
+
+// Writes frame and wait times measured by the pacer
+void WriteFramePacerReport(const std::wstring &filename);
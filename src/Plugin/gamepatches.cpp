@@ -0,0 +1,71 @@
+#include "patches.h"
+#include "config.h"
+#include "gameversion.h"
+#include <list>
+#include <string>
+
+//
+// Patches of the game code. The file is also built into patchc, so static
+// patches here must not use Windows or the plugin runtime.
+//
+
+// Implement your patches here
+// TODO: More complex example with using Hook library
+
+static bool PKEnabled(const SPluginConfig &config)
+{
+    return config.EnablePK;
+}
+
+static bool PKPatch(Patcher::SPatch &patch)
+{
+    // jz becomes jmp
+    patch.ExpectByte(GameAddr(GA_PK_JUMP), 0x74);
+    patch.WriteByte(GameAddr(GA_PK_JUMP), 0xEB);
+    return true;
+}
+
+static bool StartZoneEnabled(const SPluginConfig &config)
+{
+    return !config.StartZoneName.empty();
+}
+
+static bool StartZonePatch(Patcher::SPatch &patch)
+{
+    // The game may still use a previous name after a reload, so all of them are kept
+    static std::list<std::string> zones;
+    zones.push_back(PluginConfig.StartZoneName);
+
+    // Only the operand is written: the opcode is the signature of the game build, and a reload
+    // changes the aligned operand with one store
+    auto name = (uint8_t *)GameAddr(GA_START_ZONE_NAME);
+    patch.ExpectByte(name - 1, 0x68);
+    patch.WriteU32(name, (uint32_t)zones.back().c_str());
+    return true;
+}
+
+// Copies an input of a patch from a reloaded config, returns true if it was changed
+template <class T>
+static bool UpdateInput(T &value, const T &newValue)
+{
+    if (value == newValue)
+        return false;
+    value = newValue;
+    return true;
+}
+
+static bool PKReload(const SPluginConfig &config)
+{
+    return UpdateInput(PluginConfig.EnablePK, config.EnablePK);
+}
+
+static bool StartZoneReload(const SPluginConfig &config)
+{
+    return UpdateInput(PluginConfig.StartZoneName, config.StartZoneName);
+}
+
+// Register your patches like these, they may be declared in any file. PK is static, StartZone
+// refers to a string of the plugin
+REGISTER_PATCH(PK, PKEnabled, PKPatch, PKReload, {{GA_PK_JUMP, 1}}, {}, true);
+REGISTER_PATCH(StartZone, StartZoneEnabled, StartZonePatch, StartZoneReload,
+               {{GA_START_ZONE_NAME, 4}}, {});
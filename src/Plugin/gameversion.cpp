@@ -0,0 +1,46 @@
+#include "gameversion.h"
+#include "Shared/Common.h"
+
+using namespace Common;
+
+const SGameVersion *GameVersion = nullptr;
+
+const uint32_t PageSize = 4096;
+
+// Add other builds here, with the same order of addresses as in EGameAddress. The signature of
+// the original build is the opcode of the start zone push, StartZone changes only its operand
+static const SGameVersion GameVersions[] = {
+    {"Original", 0x400000, {0x1000, 0x33A000}, {0x33B000, 0x48000}, {0x4A5D17, 1, {0x68}},
+     {0x554144, 0x4A5D18}},
+};
+
+static bool SameSignature(const SGameSignature &signature, const PeImage::CPeImage &image)
+{
+    uint32_t base = image.GetImageBase();
+    if (signature.Addr < base)
+        return false;
+    const uint8_t *data = image.GetData(signature.Addr - base, signature.Size);
+    return data != nullptr && FindMismatch(data, signature.Bytes, signature.Size) == signature.Size;
+}
+
+static bool SameSection(const SGameSection &expected, const PeImage::SSection *section)
+{
+    return section != nullptr && section->Rva == expected.Rva &&
+           (section->Size + PageSize - 1) / PageSize * PageSize == expected.Size;
+}
+
+const SGameVersion *FindGameVersion(const PeImage::CPeImage &image)
+{
+    const PeImage::SSection *text = image.FindSection(".text");
+    const PeImage::SSection *rdata = image.FindSection(".rdata");
+    for (size_t i = 0; i < sizeof(GameVersions) / sizeof(GameVersions[0]); i++)
+    {
+        const SGameVersion &version = GameVersions[i];
+        if (version.ImageBase == image.GetImageBase() && SameSection(version.Text, text) &&
+            SameSection(version.RData, rdata) && SameSignature(version.Signature, image))
+        {
+            return &version;
+        }
+    }
+    return nullptr;
+}
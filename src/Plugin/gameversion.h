@@ -0,0 +1,59 @@
+#pragma once
+
+#include "Shared/PeImage.h"
+#include <cstdint>
+
+//
+// Addresses of the supported game builds.
+//
+// A build is recognized by the layout of its image: the base and the sections
+// patches write to. It's read from the section table, so nothing is scanned.
+// Builds with the same layout are told apart by signature bytes which are
+// compared at one address. No patch may write them, an exe already patched by
+// other tools is recognized then. Patches take addresses with GameAddr, so one plugin
+// binary serves all builds.
+//
+// The file is also built into patchc, so it must not use Windows.
+//
+
+enum EGameAddress
+{
+    GA_PK_JUMP,         // jz skipping the PK code
+    GA_START_ZONE_NAME, // Operand of the push of the start zone name
+    GA_COUNT
+};
+
+struct SGameSection
+{
+    uint32_t Rva;
+    uint32_t Size; // Rounded up to pages
+};
+
+// Bytes at an address which differ in builds with the same layout, outside of all patch ranges
+struct SGameSignature
+{
+    uint32_t Addr;
+    uint32_t Size;
+    uint8_t Bytes[16];
+};
+
+struct SGameVersion
+{
+    const char *Name;
+    uint32_t ImageBase;
+    SGameSection Text;
+    SGameSection RData;
+    SGameSignature Signature;
+    uint32_t Addresses[GA_COUNT];
+};
+
+// Selected once before patches are built, nullptr if the game build isn't supported
+extern const SGameVersion *GameVersion;
+
+// Returns nullptr for an unknown build
+const SGameVersion *FindGameVersion(const PeImage::CPeImage &image);
+
+static inline void *GameAddr(EGameAddress addr)
+{
+    return (void *)(uintptr_t)GameVersion->Addresses[addr];
+}
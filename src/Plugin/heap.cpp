@@ -0,0 +1,229 @@
+#include "config.h"
+#include "heapprof.h"
+#include "patches.h"
+#include "tracehooks.h"
+#include "Shared/Common.h"
+#include "Shared/PoolAllocator.h"
+#include "Shared/StaticHook.h"
+#include "Shared/Trace.h"
+#include <algorithm>
+#include <windows.h>
+
+using namespace Common;
+using namespace SimpleHooker86;
+
+typedef void *(__cdecl *MallocPtr)(size_t size);
+typedef void(__cdecl *FreePtr)(void *ptr);
+typedef void *(__cdecl *ReallocPtr)(void *ptr, size_t size);
+typedef size_t(__cdecl *MsizePtr)(void *ptr);
+typedef void *(__cdecl *ExpandPtr)(void *ptr, size_t size);
+typedef void *(__cdecl *RecallocPtr)(void *ptr, size_t count, size_t size);
+
+static MallocPtr OrigMalloc;
+static FreePtr OrigFree;
+static ReallocPtr OrigRealloc;
+static MsizePtr OrigMsize;
+static ExpandPtr OrigExpand;
+static RecallocPtr OrigRecalloc;
+static FreePtr OrigFreeBase;
+
+static bool UsePool = false;
+
+static void *Malloc(size_t size)
+{
+    void *ptr = UsePool ? PoolAllocator::Alloc(size) : nullptr;
+    return ptr != nullptr ? ptr : OrigMalloc(size);
+}
+
+// Blocks allocated before the hook and big blocks belong to the original heap
+static void Free(void *ptr)
+{
+    if (PoolAllocator::Owns(ptr))
+        PoolAllocator::Free(ptr);
+    else
+        OrigFree(ptr);
+}
+
+static void *Realloc(void *ptr, size_t size)
+{
+    if (ptr == nullptr)
+        return Malloc(size);
+    if (!PoolAllocator::Owns(ptr))
+        return OrigRealloc(ptr, size);
+    if (size == 0)
+    {
+        PoolAllocator::Free(ptr);
+        return nullptr;
+    }
+
+    size_t oldSize = PoolAllocator::GetBlockSize(ptr);
+    if (size <= oldSize)
+        return ptr;
+
+    // On failure the old block must stay untouched
+    void *result = Malloc(size);
+    if (result == nullptr)
+        return nullptr;
+    memcpy(result, ptr, std::min(size, oldSize));
+    PoolAllocator::Free(ptr);
+    return result;
+}
+
+static void *__cdecl HookMalloc(size_t size)
+{
+    Trace::Enter(TH_MALLOC, (uint32_t)size);
+    void *ptr = Malloc(size);
+    if (HeapProfEnabled && ptr != nullptr)
+        HeapProfAlloc(ptr, size, STATIC_HOOK_CALLER());
+    Trace::Exit(TH_MALLOC, (uint32_t)(uintptr_t)ptr);
+    return ptr;
+}
+
+static void __cdecl HookFree(void *ptr)
+{
+    Trace::Enter(TH_FREE, (uint32_t)(uintptr_t)ptr);
+    if (HeapProfEnabled && ptr != nullptr)
+        HeapProfFree(ptr);
+    Free(ptr);
+    Trace::Exit(TH_FREE);
+}
+
+static void *__cdecl HookRealloc(void *ptr, size_t size)
+{
+    Trace::Enter(TH_REALLOC, (uint32_t)(uintptr_t)ptr, (uint32_t)size);
+    // Once the block is freed, another thread may get and record the same address
+    if (HeapProfEnabled && ptr != nullptr)
+        HeapProfFree(ptr);
+    void *result = Realloc(ptr, size);
+    if (HeapProfEnabled && result != nullptr)
+        HeapProfAlloc(result, size, STATIC_HOOK_CALLER());
+    Trace::Exit(TH_REALLOC, (uint32_t)(uintptr_t)result);
+    return result;
+}
+
+static size_t __cdecl HookMsize(void *ptr)
+{
+    Trace::Enter(TH_MSIZE, (uint32_t)(uintptr_t)ptr);
+    size_t size = PoolAllocator::Owns(ptr) ? PoolAllocator::GetBlockSize(ptr) : OrigMsize(ptr);
+    Trace::Exit(TH_MSIZE, (uint32_t)size);
+    return size;
+}
+
+// A pool block can't grow in place past its size class
+static void *__cdecl HookExpand(void *ptr, size_t size)
+{
+    Trace::Enter(TH_EXPAND, (uint32_t)(uintptr_t)ptr, (uint32_t)size);
+    void *result;
+    if (PoolAllocator::Owns(ptr))
+        result = size != 0 && size <= PoolAllocator::GetBlockSize(ptr) ? ptr : nullptr;
+    else
+        result = OrigExpand(ptr, size);
+    if (HeapProfEnabled && result != nullptr)
+    {
+        HeapProfFree(ptr);
+        HeapProfAlloc(result, size, STATIC_HOOK_CALLER());
+    }
+    Trace::Exit(TH_EXPAND, (uint32_t)(uintptr_t)result);
+    return result;
+}
+
+// As the CRT does, bytes past the old _msize are zeroed. For a pool block it's the block size
+static void *__cdecl HookRecalloc(void *ptr, size_t count, size_t size)
+{
+    Trace::Enter(TH_RECALLOC, (uint32_t)(uintptr_t)ptr, (uint32_t)(count * size));
+    // Once the block is freed, another thread may get and record the same address
+    if (HeapProfEnabled && ptr != nullptr)
+        HeapProfFree(ptr);
+
+    void *result = nullptr;
+    if (ptr != nullptr && !PoolAllocator::Owns(ptr))
+        result = OrigRecalloc(ptr, count, size);
+    else if (count == 0 || size <= SIZE_MAX / count)
+    {
+        size_t oldSize = ptr != nullptr ? PoolAllocator::GetBlockSize(ptr) : 0;
+        size_t newSize = count * size;
+        result = Realloc(ptr, newSize);
+        if (result != nullptr && newSize > oldSize)
+            memset((char *)result + oldSize, 0, newSize - oldSize);
+    }
+
+    if (HeapProfEnabled && result != nullptr)
+        HeapProfAlloc(result, count * size, STATIC_HOOK_CALLER());
+    Trace::Exit(TH_RECALLOC, (uint32_t)(uintptr_t)result);
+    return result;
+}
+
+// The CRT's free calls it too, then the block isn't a pool one and is already unprofiled
+static void __cdecl HookFreeBase(void *ptr)
+{
+    Trace::Enter(TH_FREE_BASE, (uint32_t)(uintptr_t)ptr);
+    if (HeapProfEnabled && ptr != nullptr)
+        HeapProfFree(ptr);
+    if (PoolAllocator::Owns(ptr))
+        PoolAllocator::Free(ptr);
+    else
+        OrigFreeBase(ptr);
+    Trace::Exit(TH_FREE_BASE);
+}
+
+// Patches are built before the profiler is started, so its setting is checked
+static bool HeapEnabled(const SPluginConfig &config)
+{
+    return config.EnableHeapPool || !config.HeapProfReport.empty();
+}
+
+// Hooks the game's CRT heap functions to serve small blocks from the pool allocator and/or to
+// feed the allocation profiler
+static bool HeapPatch(Patcher::SPatch &patch)
+{
+    const auto &cfg = PluginConfig;
+    // Every pool block must be seen by free, realloc and _msize
+    if (!cfg.MallocAddr || !cfg.FreeAddr || !cfg.ReallocAddr ||
+        (cfg.EnableHeapPool && !cfg.MsizeAddr))
+        ErrorMsgBox(1, "Addresses of malloc, free, realloc and _msize must be set in [Heap]");
+
+    if (cfg.EnableHeapPool)
+    {
+        if (!PoolAllocator::Init((size_t)cfg.HeapPoolSizeMb * 1024 * 1024))
+            ErrorMsgBox(1, "Cannot reserve %d MB for the heap pool", cfg.HeapPoolSizeMb);
+        UsePool = true;
+    }
+
+    Trace::SetHookName(TH_MALLOC, "malloc");
+    Trace::SetHookName(TH_FREE, "free");
+    Trace::SetHookName(TH_REALLOC, "realloc");
+    Trace::SetHookName(TH_MSIZE, "_msize");
+    Trace::SetHookName(TH_EXPAND, "_expand");
+    Trace::SetHookName(TH_RECALLOC, "_recalloc");
+    Trace::SetHookName(TH_FREE_BASE, "_free_base");
+
+    // The hooks are plain cdecl functions, so the game jumps straight to them
+    if (!CREATE_STATIC_FUNC_HOOK((void *)cfg.MallocAddr, CC_CDECL, HookMalloc,
+                                 (void **)&OrigMalloc, patch) ||
+        !CREATE_STATIC_FUNC_HOOK((void *)cfg.FreeAddr, CC_CDECL, HookFree, (void **)&OrigFree,
+                                 patch) ||
+        !CREATE_STATIC_FUNC_HOOK((void *)cfg.ReallocAddr, CC_CDECL, HookRealloc,
+                                 (void **)&OrigRealloc, patch) ||
+        (UsePool && !CREATE_STATIC_FUNC_HOOK((void *)cfg.MsizeAddr, CC_CDECL, HookMsize,
+                                             (void **)&OrigMsize, patch)))
+    {
+        ErrorMsgBox(1, "Cannot hook the game heap functions");
+    }
+
+    // Other functions taking heap blocks are optional as the game may not link them. If it
+    // does, they must be set: a pool block passed to the original ones would corrupt the heap
+    if ((cfg.ExpandAddr && !CREATE_STATIC_FUNC_HOOK((void *)cfg.ExpandAddr, CC_CDECL, HookExpand,
+                                                    (void **)&OrigExpand, patch)) ||
+        (cfg.RecallocAddr &&
+         !CREATE_STATIC_FUNC_HOOK((void *)cfg.RecallocAddr, CC_CDECL, HookRecalloc,
+                                  (void **)&OrigRecalloc, patch)) ||
+        (cfg.FreeBaseAddr &&
+         !CREATE_STATIC_FUNC_HOOK((void *)cfg.FreeBaseAddr, CC_CDECL, HookFreeBase,
+                                  (void **)&OrigFreeBase, patch)))
+    {
+        ErrorMsgBox(1, "Cannot hook the optional game heap functions");
+    }
+    return true;
+}
+
+REGISTER_PATCH(Heap, HeapEnabled, HeapPatch, nullptr, {}, {});
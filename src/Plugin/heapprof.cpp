@@ -0,0 +1,388 @@
+#include "heapprof.h"
+#include "Shared/Common.h"
+#include "Shared/Histogram.h"
+#include <algorithm>
+#include <vector>
+#include <windows.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+volatile bool HeapProfEnabled = false;
+
+namespace {
+
+// Class i holds sizes up to 16 << i, the last one holds everything bigger
+const size_t SizeClassCount = 14;
+const size_t CallSiteCount = 4096; // Per thread, must be a power of 2
+const size_t CallSiteProbes = 16;
+const size_t LiveBlockCount = 65536; // Must be a power of 2
+const size_t LiveBlockProbes = 8;
+const DWORD StopTimeoutMs = 1000;
+
+struct SClassStats
+{
+    uint32_t Allocs;
+    uint64_t Bytes;
+    Stats::SHistogram Lifetimes; // TSC ticks of sampled blocks
+};
+
+struct SCallSite
+{
+    const void *Addr;
+    uint32_t Allocs;
+    uint64_t Bytes;
+};
+
+// Written by the owner thread only. The report thread reads it without
+// synchronization, so a report may miss the latest few allocations
+struct SThreadStats
+{
+    SThreadStats *Next;
+    uint32_t SampleCountdown;
+    uint32_t LostAllocs; // Allocations from call sites which didn't fit the table
+    uint64_t LostBytes;
+    SClassStats Classes[SizeClassCount];
+    SCallSite Sites[CallSiteCount];
+};
+
+struct SLiveBlock
+{
+    const void *volatile Ptr;
+    uint32_t SizeClass;
+    uint64_t Ticks;
+};
+
+static size_t GetSizeClass(size_t size)
+{
+    size_t cls = 0;
+    while (cls < SizeClassCount - 1 && size > ((size_t)16 << cls))
+        cls++;
+    return cls;
+}
+
+static size_t HashPointer(const void *ptr)
+{
+    return (size_t)(((uint32_t)(uintptr_t)ptr >> 2) * 2654435761u);
+}
+
+class CHeapProfiler
+{
+public:
+    CHeapProfiler()
+        : _tlsIndex(TLS_OUT_OF_INDEXES)
+        , _threads(nullptr)
+        , _liveBlocks(nullptr)
+        , _liveCount(0)
+        , _thread(NULL)
+        , _stopEvent(NULL)
+        , _intervalMs(0)
+        , _sampleRate(1)
+        , _topCount(0)
+        , _startTicks(0)
+    {
+    }
+
+    bool Start(const std::wstring &filename, unsigned intervalSec, unsigned sampleRate,
+               unsigned topCount)
+    {
+        _filename = filename;
+        _intervalMs = intervalSec != 0 ? intervalSec * 1000 : INFINITE;
+        _sampleRate = sampleRate != 0 ? sampleRate : 1;
+        _topCount = topCount;
+
+        _tlsIndex = TlsAlloc();
+        if (_tlsIndex == TLS_OUT_OF_INDEXES)
+            return false;
+        _liveBlocks = (SLiveBlock *)VirtualAlloc(NULL, sizeof(SLiveBlock) * LiveBlockCount,
+                                                 MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        _stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (_liveBlocks == nullptr || _stopEvent == NULL)
+            return false;
+
+        QueryPerformanceCounter(&_startQpc);
+        _startTicks = __rdtsc();
+        HeapProfEnabled = true;
+
+        _thread = CreateThread(NULL, 0, ReportThread, this, 0, NULL);
+        if (_thread == NULL)
+        {
+            // Nobody would merge the tables
+            HeapProfEnabled = false;
+            return false;
+        }
+        return true;
+    }
+
+    void Stop()
+    {
+        if (_thread == NULL)
+            return;
+        SetEvent(_stopEvent);
+        WaitForSingleObject(_thread, StopTimeoutMs);
+        CloseHandle(_thread);
+        _thread = NULL;
+
+        // Hooks stay installed until the process exits, so stats are not freed
+        WriteReport();
+    }
+
+    void Alloc(const void *ptr, size_t size, const void *caller)
+    {
+        SThreadStats *stats = GetStats();
+        if (stats == nullptr)
+            return;
+
+        size_t cls = GetSizeClass(size);
+        stats->Classes[cls].Allocs++;
+        stats->Classes[cls].Bytes += size;
+        AddCallSite(stats, caller, size);
+
+        if (--stats->SampleCountdown == 0)
+        {
+            stats->SampleCountdown = _sampleRate;
+            AddLiveBlock(ptr, cls);
+        }
+    }
+
+    void Free(const void *ptr)
+    {
+        if (_liveCount == 0)
+            return;
+        SThreadStats *stats = GetStats();
+        if (stats == nullptr)
+            return;
+
+        size_t index = HashPointer(ptr);
+        for (size_t i = 0; i < LiveBlockProbes; i++)
+        {
+            SLiveBlock &block = _liveBlocks[(index + i) & (LiveBlockCount - 1)];
+            if (block.Ptr != ptr)
+                continue;
+
+            // Only the block's owner may free it, so nobody else can clear the slot now
+            stats->Classes[block.SizeClass].Lifetimes.Record(__rdtsc() - block.Ticks);
+            block.Ptr = nullptr;
+            InterlockedDecrement(&_liveCount);
+            return;
+        }
+    }
+
+private:
+    DWORD _tlsIndex;
+    SThreadStats *volatile _threads;
+    SLiveBlock *_liveBlocks;
+    volatile LONG _liveCount;
+    HANDLE _thread;
+    HANDLE _stopEvent;
+    std::wstring _filename;
+    DWORD _intervalMs;
+    uint32_t _sampleRate;
+    size_t _topCount;
+    uint64_t _startTicks;
+    LARGE_INTEGER _startQpc;
+
+    SThreadStats *GetStats()
+    {
+        // TlsGetValue always resets the last error, but the game may rely on it
+        DWORD lastError = GetLastError();
+        auto stats = (SThreadStats *)TlsGetValue(_tlsIndex);
+        if (stats == nullptr)
+            stats = CreateStats();
+        SetLastError(lastError);
+        return stats;
+    }
+
+    SThreadStats *CreateStats()
+    {
+        // VirtualAlloc doesn't go through the hooked heap, so it can't recurse here
+        auto stats = (SThreadStats *)VirtualAlloc(NULL, sizeof(SThreadStats),
+                                                  MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (stats == nullptr)
+            return nullptr;
+
+        stats->SampleCountdown = _sampleRate;
+        for (size_t i = 0; i < SizeClassCount; i++)
+            stats->Classes[i].Lifetimes.Reset();
+
+        SThreadStats *head;
+        do
+        {
+            head = _threads;
+            stats->Next = head;
+        } while (InterlockedCompareExchangePointer((void *volatile *)&_threads, stats, head) !=
+                 head);
+
+        TlsSetValue(_tlsIndex, stats);
+        return stats;
+    }
+
+    static void AddCallSite(SThreadStats *stats, const void *caller, size_t size)
+    {
+        size_t index = HashPointer(caller);
+        for (size_t i = 0; i < CallSiteProbes; i++)
+        {
+            SCallSite &site = stats->Sites[(index + i) & (CallSiteCount - 1)];
+            if (site.Addr == nullptr)
+                site.Addr = caller;
+            if (site.Addr == caller)
+            {
+                site.Allocs++;
+                site.Bytes += size;
+                return;
+            }
+        }
+        stats->LostAllocs++;
+        stats->LostBytes += size;
+    }
+
+    void AddLiveBlock(const void *ptr, size_t cls)
+    {
+        size_t index = HashPointer(ptr);
+        for (size_t i = 0; i < LiveBlockProbes; i++)
+        {
+            SLiveBlock &block = _liveBlocks[(index + i) & (LiveBlockCount - 1)];
+            if (InterlockedCompareExchangePointer((void *volatile *)&block.Ptr, (void *)ptr,
+                                                  nullptr) != nullptr)
+                continue;
+
+            // The block can't be freed before this function returns
+            block.SizeClass = (uint32_t)cls;
+            block.Ticks = __rdtsc();
+            InterlockedIncrement(&_liveCount);
+            return;
+        }
+        // The table is crowded with leaked blocks, skip this sample
+    }
+
+    static DWORD WINAPI ReportThread(LPVOID param)
+    {
+        auto profiler = (CHeapProfiler *)param;
+        while (WaitForSingleObject(profiler->_stopEvent, profiler->_intervalMs) == WAIT_TIMEOUT)
+            profiler->WriteReport();
+        return 0;
+    }
+
+    double GetTicksPerUs() const
+    {
+        LARGE_INTEGER qpc, qpcFreq;
+        QueryPerformanceCounter(&qpc);
+        QueryPerformanceFrequency(&qpcFreq);
+        uint64_t ticks = __rdtsc();
+        double qpcElapsed = (double)(qpc.QuadPart - _startQpc.QuadPart);
+        return qpcElapsed > 0 ? (ticks - _startTicks) * (double)qpcFreq.QuadPart / qpcElapsed / 1e6
+                              : 1.0;
+    }
+
+    void WriteReport()
+    {
+        SClassStats *classes = new SClassStats[SizeClassCount]();
+        std::vector<SCallSite> sites;
+        uint64_t lostAllocs = 0, lostBytes = 0;
+
+        for (SThreadStats *stats = _threads; stats != nullptr; stats = stats->Next)
+        {
+            for (size_t i = 0; i < SizeClassCount; i++)
+            {
+                classes[i].Allocs += stats->Classes[i].Allocs;
+                classes[i].Bytes += stats->Classes[i].Bytes;
+                classes[i].Lifetimes.Merge(stats->Classes[i].Lifetimes);
+            }
+            for (size_t i = 0; i < CallSiteCount; i++)
+            {
+                if (stats->Sites[i].Addr != nullptr)
+                    sites.push_back(stats->Sites[i]);
+            }
+            lostAllocs += stats->LostAllocs;
+            lostBytes += stats->LostBytes;
+        }
+
+        // Merge entries of the same call site from different threads
+        std::sort(sites.begin(), sites.end(), [](const SCallSite &a, const SCallSite &b) {
+            return a.Addr < b.Addr;
+        });
+        size_t count = 0;
+        for (size_t i = 0; i < sites.size(); i++)
+        {
+            if (count != 0 && sites[count - 1].Addr == sites[i].Addr)
+            {
+                sites[count - 1].Allocs += sites[i].Allocs;
+                sites[count - 1].Bytes += sites[i].Bytes;
+            }
+            else
+                sites[count++] = sites[i];
+        }
+        sites.resize(count);
+        std::sort(sites.begin(), sites.end(), [](const SCallSite &a, const SCallSite &b) {
+            return a.Bytes > b.Bytes;
+        });
+
+        double ticksPerUs = GetTicksPerUs();
+        std::string report;
+        char line[256];
+        sprintf_s(line, "%-10s %12s %14s %10s %12s %12s %12s (lifetime, us)\r\n", "Size", "Allocs",
+                  "Bytes", "Sampled", "p50", "p90", "p99");
+        report += line;
+        for (size_t i = 0; i < SizeClassCount; i++)
+        {
+            const SClassStats &cs = classes[i];
+            if (i < SizeClassCount - 1)
+                sprintf_s(line, "<= %-7u", 16u << i);
+            else
+                sprintf_s(line, "> %-8u", 16u << (i - 1));
+            report += line;
+            sprintf_s(line, " %12u %14llu %10u %12.1f %12.1f %12.1f\r\n", cs.Allocs,
+                      (unsigned long long)cs.Bytes, (unsigned)cs.Lifetimes.Count,
+                      cs.Lifetimes.GetPercentile(50) / ticksPerUs,
+                      cs.Lifetimes.GetPercentile(90) / ticksPerUs,
+                      cs.Lifetimes.GetPercentile(99) / ticksPerUs);
+            report += line;
+        }
+
+        sprintf_s(line, "\r\n%-10s %12s %14s %10s\r\n", "Caller", "Allocs", "Bytes", "Avg");
+        report += line;
+        for (size_t i = 0; i < sites.size() && i < _topCount; i++)
+        {
+            sprintf_s(line, "0x%08X %12u %14llu %10.1f\r\n", (uint32_t)(uintptr_t)sites[i].Addr,
+                      sites[i].Allocs, (unsigned long long)sites[i].Bytes,
+                      (double)sites[i].Bytes / sites[i].Allocs);
+            report += line;
+        }
+        if (lostAllocs != 0)
+        {
+            sprintf_s(line, "%-10s %12llu %14llu\r\n", "(lost)", (unsigned long long)lostAllocs,
+                      (unsigned long long)lostBytes);
+            report += line;
+        }
+
+        delete[] classes;
+        Common::WriteFileFull(_filename, report);
+    }
+};
+
+} // namespace
+
+static CHeapProfiler profiler;
+
+bool HeapProfStart(const std::wstring &filename, unsigned intervalSec, unsigned sampleRate,
+                   unsigned topCount)
+{
+    return profiler.Start(filename, intervalSec, sampleRate, topCount);
+}
+
+void HeapProfStop()
+{
+    profiler.Stop();
+}
+
+void HeapProfAlloc(const void *ptr, size_t size, const void *caller)
+{
+    profiler.Alloc(ptr, size, caller);
+}
+
+void HeapProfFree(const void *ptr)
+{
+    profiler.Free(ptr);
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+//
+// Allocation profiler for the game heap, fed by the hooks from heap.cpp.
+//
+// Every thread counts its allocations per size class and per call site in its
+// own tables, so recording takes no locks. Lifetimes are measured for one of
+// every SampleRate allocations only. A background thread merges the tables
+// and rewrites the report every interval.
+//
+
+bool HeapProfStart(const std::wstring &filename, unsigned intervalSec, unsigned sampleRate,
+                   unsigned topCount);
+void HeapProfStop();
+
+void HeapProfAlloc(const void *ptr, size_t size, const void *caller);
+void HeapProfFree(const void *ptr);
+
+extern volatile bool HeapProfEnabled;
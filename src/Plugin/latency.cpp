@@ -0,0 +1,90 @@
+#include "latency.h"
+#include "config.h"
+#include "patches.h"
+#include "tracehooks.h"
+#include "Shared/Common.h"
+#include "Shared/Hook.h"
+#include "Shared/Trace.h"
+#include <windows.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+using namespace Common;
+
+static const size_t MaxLatencyFunctions = 64;
+static Stats::SAtomicHistogram Histograms[MaxLatencyFunctions];
+static size_t HistogramCount = 0;
+
+// Used to convert TSC ticks to microseconds
+static uint64_t StartTicks;
+static LARGE_INTEGER StartQpc;
+
+static bool LatencyEnabled(const SPluginConfig &config)
+{
+    return !config.LatencyFunctions.empty();
+}
+
+static bool LatencyPatch(Patcher::SPatch &patch)
+{
+    const auto &funcs = PluginConfig.LatencyFunctions;
+    if (funcs.size() > MaxLatencyFunctions)
+        ErrorMsgBox(1, "Too many functions in [Latency] section. Max: %u",
+                    (unsigned)MaxLatencyFunctions);
+
+    for (size_t i = 0; i < funcs.size(); i++)
+    {
+        auto traceId = (uint16_t)(TH_LATENCY + i);
+        if (!SimpleHooker86::CreateTimingHook((void *)funcs[i], &Histograms[i], traceId, patch))
+            ErrorMsgBox(1, "Cannot create timing hook for function 0x%X", funcs[i]);
+
+        char name[16];
+        sprintf_s(name, "0x%08X", funcs[i]);
+        Trace::SetHookName(traceId, name);
+    }
+    HistogramCount = funcs.size();
+
+    QueryPerformanceCounter(&StartQpc);
+    StartTicks = __rdtsc();
+    return true;
+}
+
+// Hooks can't be removed, changes of their settings need a restart
+REGISTER_PATCH(Latency, LatencyEnabled, LatencyPatch, nullptr, {}, {});
+
+void WriteLatencyReport(const std::wstring &filename)
+{
+    if (HistogramCount == 0)
+        return;
+
+    LARGE_INTEGER qpc, qpcFreq;
+    QueryPerformanceCounter(&qpc);
+    QueryPerformanceFrequency(&qpcFreq);
+    uint64_t ticks = __rdtsc();
+    double qpcElapsed = (double)(qpc.QuadPart - StartQpc.QuadPart);
+    double ticksPerUs = qpcElapsed > 0
+                            ? (ticks - StartTicks) * (double)qpcFreq.QuadPart / qpcElapsed / 1e6
+                            : 1.0;
+
+    std::string report;
+    char line[256];
+    sprintf_s(line, "%-10s %12s %10s %10s %10s %10s %10s %10s (us)\r\n", "Function", "Calls",
+              "Mean", "Min", "p50", "p90", "p99", "Max");
+    report += line;
+
+    for (size_t i = 0; i < HistogramCount; i++)
+    {
+        Stats::SHistogram h;
+        Histograms[i].Snapshot(h);
+        sprintf_s(line, "0x%08X %12llu %10.2f %10.2f %10.2f %10.2f %10.2f %10.2f\r\n",
+                  PluginConfig.LatencyFunctions[i], (unsigned long long)h.Count,
+                  h.GetMean() / ticksPerUs, h.Count != 0 ? h.Min / ticksPerUs : 0.0,
+                  h.GetPercentile(50) / ticksPerUs, h.GetPercentile(90) / ticksPerUs,
+                  h.GetPercentile(99) / ticksPerUs, h.Max / ticksPerUs);
+        report += line;
+    }
+
+    WriteFileFull(filename, report);
+}
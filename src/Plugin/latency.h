@@ -0,0 +1,7 @@
+#pragma once
+
+#include <string>
+
+// Functions listed in [Latency] section of config are hooked by Latency patch to measure their
+// execution time
+void WriteLatencyReport(const std::wstring &filename);
@@ -1,7 +1,15 @@
 #include "patches.h"
 #include "config.h"
+#include "configcache.h"
+#include "framepacer.h"
+#include "heapprof.h"
+#include "latency.h"
+#include "reload.h"
+#include "startup.h"
 #include "VersionInfo.h"
 #include "Shared/Common.h"
+#include "Shared/Hook.h"
+#include "Shared/Trace.h"
 #include <windows.h>
 
 #if !defined(_M_IX86) && !defined(__i386__)
@@ -11,11 +19,77 @@
 // Calling convention used for plugin. Must be cdecl
 #define PLUGIN_DECL __cdecl
 
+static std::wstring PluginDir;
+static HANDLE PreparedEvent = NULL;
+static volatile LONG PrepareClaimed = 0;
+
+// Loads the config and builds patches. It's started from DllMain on a separate thread, which
+// can't run until the loader lock is released, so the first of it and EntryBeforePatch does
+// the work and the other one waits for it
+static void Prepare()
+{
+    if (InterlockedExchange(&PrepareClaimed, 1) != 0)
+    {
+        WaitForSingleObject(PreparedEvent, INFINITE);
+        return;
+    }
+
+    int64_t start = StartupNow();
+    LoadConfig(PluginConfig, PluginDir + L"plugin.ini");
+    StartupAddTime(SP_CONFIG_LOAD, start);
+    const auto &cfg = PluginConfig;
+    PreparePatches(cfg.PatchImageFile.empty() ? std::wstring()
+                                              : PluginDir + Common::AnsiToWide(cfg.PatchImageFile));
+    SetEvent(PreparedEvent);
+}
+
+static DWORD WINAPI PrepareThread(LPVOID)
+{
+    Prepare();
+    return 0;
+}
+
 int PLUGIN_DECL EntryBeforePatch(const char *modPath)
 {
+    int64_t start = StartupNow();
+    Prepare();
+    StartupAddTime(SP_WAIT_PREPARED, start);
+
+    // Problems of the config are shown here, a message box can't be shown while it's loaded
+    if (!PluginConfig.Warnings.empty())
+    {
+        std::string text;
+        for (size_t i = 0; i < PluginConfig.Warnings.size(); i++)
+            text += "\n" + PluginConfig.Warnings[i];
+        Common::ErrorMsgBox(0, "Errors in plugin.ini:%s", text.c_str());
+    }
+
+    // Start tracing before any hook can be called
+    if (!PluginConfig.TraceFile.empty())
+    {
+        if (Trace::Start(PluginDir + Common::AnsiToWide(PluginConfig.TraceFile)))
+            SimpleHooker86::SetTimingHookTracer(Trace::Enter, Trace::Exit);
+        else
+            Common::ErrorMsgBox(0, "Cannot create trace file %s", PluginConfig.TraceFile.c_str());
+    }
+
+    // The heap hooks feed the profiler only if it's started
+    const auto &cfg = PluginConfig;
+    if (!cfg.HeapProfReport.empty() &&
+        !HeapProfStart(PluginDir + Common::AnsiToWide(cfg.HeapProfReport), cfg.HeapProfInterval,
+                       cfg.HeapProfSampleRate, cfg.HeapProfTop))
+    {
+        Common::ErrorMsgBox(0, "Cannot start heap profiler");
+    }
+
     // Some code executed before addon.dll patches
-    // Patch the game here if you want addon to check collision (recommended)
+    // Patch the game here if you want addon to check collision (recommended).
+    // Only prepared bytes are written here
     ApplyPatches();
+
+    if (PluginConfig.HotReload && !ConfigWatchStart(PluginDir + L"plugin.ini"))
+        Common::ErrorMsgBox(0, "Cannot watch plugin.ini for changes");
+    StartupAddTime(SP_ENTRY_BEFORE_PATCH, start);
     return 0;
 }
 
@@ -23,6 +97,9 @@ int PLUGIN_DECL EntryAfterPatch(const char *modPath)
 {
     // Some code executed after addon.dll patches
     // Patch the game here if you want to care about collisions with addon yourself
+
+    if (!PluginConfig.StartupReport.empty())
+        WriteStartupReport(PluginDir + Common::AnsiToWide(PluginConfig.StartupReport));
     return 0;
 }
 
@@ -54,16 +131,31 @@ BOOL APIENTRY DllMain(HINSTANCE hInstanceDLL, DWORD fdwReason, LPVOID)
     case DLL_THREAD_DETACH:
         break;
     case DLL_PROCESS_ATTACH: {
+        int64_t start = StartupNow();
         DisableThreadLibraryCalls(hInstanceDLL);
 
-        // Load config
-        auto pluginDir = Common::GetDirectoryName(Common::GetCurrentModulePath());
-        Common::AddTrailingSlash(pluginDir);
-        PluginConfig.Load(Common::WideToAnsi(pluginDir) + "plugin.ini");
+        PluginDir = Common::GetDirectoryName(Common::GetCurrentModulePath());
+        Common::AddTrailingSlash(PluginDir);
+
+        // Nothing else is done under the loader lock
+        PreparedEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        VERIFY(PreparedEvent != NULL);
+        HANDLE thread = CreateThread(NULL, 0, PrepareThread, NULL, 0, NULL);
+        if (thread != NULL)
+            CloseHandle(thread);
+        StartupAddTime(SP_DLL_MAIN, start);
 
         break;
     }
     case DLL_PROCESS_DETACH:
+        ConfigWatchStop();
+        Trace::Stop();
+        HeapProfStop();
+        FramePacerStop();
+        if (!PluginConfig.LatencyReport.empty())
+            WriteLatencyReport(PluginDir + Common::AnsiToWide(PluginConfig.LatencyReport));
+        if (!PluginConfig.FramePacerReport.empty())
+            WriteFramePacerReport(PluginDir + Common::AnsiToWide(PluginConfig.FramePacerReport));
         break;
     }
     return TRUE;
@@ -1,84 +1,735 @@
 #include "patches.h"
 #include "config.h"
+#include "startup.h"
 #include "Shared/Common.h"
+#include "Shared/PatchImage.h"
+#include "Shared/PeImage.h"
 #include "Shared/Patcher.h"
+#include <algorithm>
+#include <climits>
+#include <cstring>
 #include <windows.h>
 
 using namespace Common;
 
-// Implement your patches here
-// TODO: More complex example with using Hook library
+SPatchDesc *SPatchDesc::First = nullptr;
 
-static bool PKPatch(Patcher::SPatch &patch)
+// Game bytes [Addr, End) written by a patch
+struct SWriteRange
 {
-    if (!PluginConfig.EnablePK)
-        return false;
+    uintptr_t Addr;
+    uintptr_t End;
+};
+
+struct SPatchNode
+{
+    SPatchDesc *Desc;
+    std::vector<size_t> Dependencies; // Indexes of nodes, they are before this one
+    std::vector<size_t> Dependents;
+    volatile LONG PendingDependencies;
+    bool Enabled;
+    bool Prebuilt; // Taken from the patch image
+    Patcher::SPatch Prepared;
+    std::vector<Patcher::SChunkRef> Writes;   // Into Prepared or into the mapped patch image
+    std::vector<Patcher::SChunkRef> Expected; // Into Prepared
+    Patcher::SPatch Backup;                 // Original bytes under a reloadable patch
+    std::vector<SWriteRange> Written;       // By the applied patch, to check reloaded ones
+};
+
+// Registered patches in the order of applying
+static std::vector<SPatchNode> _Nodes;
 
-    patch.WriteByte((void *)0x554144, 0xEB);
-    return true;
+static size_t FindNode(const std::vector<SPatchDesc *> &descs, const char *name)
+{
+    for (size_t i = 0; i < descs.size(); i++)
+    {
+        if (strcmp(descs[i]->Name, name) == 0)
+            return i;
+    }
+    return descs.size();
 }
 
-static bool StartZonePatch(Patcher::SPatch &patch)
+// Orders patches so every one follows its dependencies. Independent patches are sorted by names,
+// so the order doesn't depend on the order of static initialization
+static void SortPatches()
 {
-    if (PluginConfig.StartZoneName.empty())
-        return false;
+    std::vector<SPatchDesc *> descs;
+    for (SPatchDesc *desc = SPatchDesc::First; desc != nullptr; desc = desc->Next)
+        descs.push_back(desc);
+    std::sort(descs.begin(), descs.end(), [](const SPatchDesc *a, const SPatchDesc *b) {
+        return strcmp(a->Name, b->Name) < 0;
+    });
+
+    size_t count = descs.size();
+    std::vector<std::vector<size_t>> dependents(count);
+    std::vector<size_t> pending(count, 0);
+    for (size_t i = 0; i < count; i++)
+    {
+        if (i > 0 && strcmp(descs[i - 1]->Name, descs[i]->Name) == 0)
+            ErrorMsgBox(1, "Patch %s is registered twice", descs[i]->Name);
 
-    // Copy config parameter to protect from config changes
-    static const auto zone = PluginConfig.StartZoneName;
+        const auto &deps = descs[i]->Dependencies;
+        for (auto it = deps.cbegin(); it != deps.cend(); ++it)
+        {
+            size_t dep = FindNode(descs, *it);
+            if (dep == count)
+                ErrorMsgBox(1, "Patch %s depends on unknown patch %s", descs[i]->Name, *it);
+            // A reloaded dependency would change under it
+            if (descs[dep]->Reload != nullptr && descs[i]->Reload == nullptr)
+            {
+                ErrorMsgBox(1, "Patch %s depends on reloadable patch %s, so it must be reloadable",
+                            descs[i]->Name, *it);
+            }
+            dependents[dep].push_back(i);
+            pending[i]++;
+        }
+    }
+
+    // Kahn's algorithm taking the first ready patch by name every time
+    std::vector<size_t> order, position(count, count);
+    while (order.size() < count)
+    {
+        size_t next = 0;
+        while (next < count && (pending[next] != 0 || position[next] != count))
+            next++;
+        if (next == count)
+            ErrorMsgBox(1, "Dependencies of patches form a cycle");
+
+        position[next] = order.size();
+        order.push_back(next);
+        for (auto it = dependents[next].cbegin(); it != dependents[next].cend(); ++it)
+            pending[*it]--;
+    }
 
-    patch.WritePush((void *)0x4A5D17, (uint32_t)zone.c_str());
-    return true;
+    _Nodes.resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        SPatchNode &node = _Nodes[position[i]];
+        node.Desc = descs[i];
+        node.PendingDependencies = 0;
+        node.Prebuilt = false;
+        for (auto it = dependents[i].cbegin(); it != dependents[i].cend(); ++it)
+        {
+            node.Dependents.push_back(position[*it]);
+            _Nodes[position[*it]].Dependencies.push_back(position[i]);
+        }
+    }
 }
 
-typedef bool (*PatchFunction)(Patcher::SPatch &patch);
-static const PatchFunction Patches[] = {
-    // Put your patch functions here:
-    PKPatch,
-    StartZonePatch,
-};
+// A patch is built when its dependencies are built, it may use results of their functions.
+// The scheduling state lives until the process exits, because helper threads may start after
+// all patches are built
+static CRITICAL_SECTION _ReadyLock;
+static std::vector<size_t> _ReadyNodes;
+static HANDLE _ReadySemaphore = NULL;
+static volatile LONG _DoneNodes = 0;
+static LONG _WorkerCount = 1; // With the thread of PreparePatches
+
+static void PushReadyNode(size_t index)
+{
+    EnterCriticalSection(&_ReadyLock);
+    _ReadyNodes.push_back(index);
+    LeaveCriticalSection(&_ReadyLock);
+    ReleaseSemaphore(_ReadySemaphore, 1, NULL);
+}
+
+static void PrepareNode(size_t index)
+{
+    // A dependency which failed to build disables its dependents. They were finished before
+    // the counter of this node reached zero, so their state is visible
+    SPatchNode &node = _Nodes[index];
+    for (auto it = node.Dependencies.cbegin(); it != node.Dependencies.cend(); ++it)
+        node.Enabled = node.Enabled && _Nodes[*it].Enabled;
+    if (node.Enabled && !node.Prebuilt)
+    {
+        int64_t start = StartupNow();
+        node.Enabled = node.Desc->Apply(node.Prepared);
+        if (node.Enabled)
+        {
+            Patcher::GetChunkRefs(node.Prepared.Chunks, node.Writes);
+            Patcher::GetChunkRefs(node.Prepared.Expected, node.Expected);
+        }
+        StartupAddPatchTime(index, node.Desc->Name, start);
+    }
+
+    for (auto it = node.Dependents.cbegin(); it != node.Dependents.cend(); ++it)
+    {
+        if (InterlockedDecrement(&_Nodes[*it].PendingDependencies) == 0)
+            PushReadyNode(*it);
+    }
+
+    // Wake all workers to exit
+    if (InterlockedIncrement(&_DoneNodes) == (LONG)_Nodes.size())
+        ReleaseSemaphore(_ReadySemaphore, _WorkerCount, NULL);
+}
+
+static void PrepareReadyNodes()
+{
+    while (_DoneNodes != (LONG)_Nodes.size())
+    {
+        WaitForSingleObject(_ReadySemaphore, INFINITE);
+
+        bool found = false;
+        size_t index = 0;
+        EnterCriticalSection(&_ReadyLock);
+        if (!_ReadyNodes.empty())
+        {
+            index = _ReadyNodes.back();
+            _ReadyNodes.pop_back();
+            found = true;
+        }
+        LeaveCriticalSection(&_ReadyLock);
+
+        if (found)
+            PrepareNode(index);
+    }
+}
+
+static DWORD WINAPI PrepareThread(LPVOID)
+{
+    PrepareReadyNodes();
+    return 0;
+}
+
+// _Related[i][j] is true if the patch i depends on the patch j directly or indirectly
+static std::vector<std::vector<bool>> _Related;
+
+static void FindRelatedPatches()
+{
+    size_t count = _Nodes.size();
+    _Related.assign(count, std::vector<bool>(count, false));
+    for (size_t i = 0; i < count; i++)
+    {
+        const auto &deps = _Nodes[i].Dependencies;
+        for (auto it = deps.cbegin(); it != deps.cend(); ++it)
+        {
+            _Related[i][*it] = true;
+            for (size_t j = 0; j < count; j++)
+                _Related[i][j] = _Related[i][j] || _Related[*it][j];
+        }
+    }
+}
+
+static bool IsInRanges(const SPatchNode &node, const SWriteRange &write)
+{
+    const auto &ranges = node.Desc->Ranges;
+    bool inside = ranges.empty();
+    for (auto r = ranges.cbegin(); r != ranges.cend() && !inside; ++r)
+    {
+        uintptr_t addr = GameVersion->Addresses[r->Addr];
+        inside = write.Addr >= addr && write.End <= addr + r->Size;
+    }
+    return inside;
+}
+
+// The game build wouldn't be recognized in an exe patched so
+static bool WritesSignature(const SWriteRange &write)
+{
+    uintptr_t addr = GameVersion != nullptr ? GameVersion->Signature.Addr : 0;
+    return addr != 0 && write.Addr < addr + GameVersion->Signature.Size && addr < write.End;
+}
+
+// Checks that patches write only inside their declared ranges and independent patches don't
+// write the same bytes, as they can be built in any order
+static void CheckPatches()
+{
+    FindRelatedPatches();
+
+    struct SWrite
+    {
+        SWriteRange Range;
+        size_t Node;
+    };
+    std::vector<SWrite> writes;
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        const SPatchNode &node = _Nodes[i];
+        if (!node.Enabled)
+            continue;
+        for (auto it = node.Writes.cbegin(); it != node.Writes.cend(); ++it)
+        {
+            SWrite write = {{(uintptr_t)it->Addr, (uintptr_t)it->Addr + it->Size}, i};
+            if (!IsInRanges(node, write.Range))
+            {
+                ErrorMsgBox(1, "Patch %s writes 0x%X outside of its declared ranges",
+                            node.Desc->Name, (unsigned)write.Range.Addr);
+            }
+            if (WritesSignature(write.Range))
+            {
+                ErrorMsgBox(1, "Patch %s writes the signature of the game build at 0x%X",
+                            node.Desc->Name, (unsigned)write.Range.Addr);
+            }
+            writes.push_back(write);
+        }
+    }
+
+    std::sort(writes.begin(), writes.end(),
+              [](const SWrite &a, const SWrite &b) { return a.Range.Addr < b.Range.Addr; });
+    for (size_t i = 0; i < writes.size(); i++)
+    {
+        for (size_t j = i + 1; j < writes.size() && writes[j].Range.Addr < writes[i].Range.End;
+             j++)
+        {
+            size_t a = writes[i].Node, b = writes[j].Node;
+            if (a != b && !_Related[a][b] && !_Related[b][a])
+            {
+                ErrorMsgBox(1, "Patches %s and %s both write 0x%X", _Nodes[a].Desc->Name,
+                            _Nodes[b].Desc->Name, (unsigned)writes[j].Range.Addr);
+            }
+        }
+    }
+}
+
+static size_t FindNode(const char *name)
+{
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        if (strcmp(_Nodes[i].Desc->Name, name) == 0)
+            return i;
+    }
+    return _Nodes.size();
+}
+
+static void AddImageWarning(const std::wstring &path, const char *text)
+{
+    PluginConfig.Warnings.push_back("Patch image " + WideToAnsi(path) + " " + text);
+}
+
+// The game exe loaded by Windows
+static PeImage::CPeImage _GameImage;
+
+// The mapped patch image, prebuilt patches refer to it until they are applied
+static const void *_ImageView = nullptr;
+
+static void UnmapPatchImage()
+{
+    if (_ImageView != nullptr)
+    {
+        UnmapFile(_ImageView);
+        _ImageView = nullptr;
+    }
+}
+
+// Takes static patches from the image made by patchc. Nothing is taken if the image is made for
+// another game exe or config, or if any game bytes differ from the ones it expects
+static void LoadPatchImage(const std::wstring &path)
+{
+    size_t size;
+    PatchImage::CPatchImage image;
+    _ImageView = MapFileForRead(path, size);
+    if (_ImageView == nullptr || !image.Parse((const uint8_t *)_ImageView, size) ||
+        !image.VerifyCrc())
+    {
+        AddImageWarning(path, "can't be read");
+        UnmapPatchImage();
+        return;
+    }
+
+    const auto &stamp = image.GetStamp();
+    if (stamp.ExeTimeStamp != _GameImage.GetTimeStamp() ||
+        stamp.ExeImageSize != _GameImage.GetImageSize() ||
+        stamp.ConfigHash != PluginConfig.GetHash())
+    {
+        AddImageWarning(path, "is made for another game exe or config");
+        UnmapPatchImage();
+        return;
+    }
+
+    auto base = (uint32_t)(uintptr_t)GetModuleHandleW(NULL);
+    std::vector<size_t> nodes(image.GetPatchCount());
+    for (size_t i = 0; i < image.GetPatchCount(); i++)
+    {
+        nodes[i] = FindNode(image.GetPatchName(i));
+        if (nodes[i] == _Nodes.size() || !_Nodes[nodes[i]].Desc->Static)
+        {
+            AddImageWarning(path, "has unknown patches");
+            UnmapPatchImage();
+            return;
+        }
+        for (size_t j = 0; j < image.GetRunCount(i); j++)
+        {
+            auto run = image.GetRun(i, j);
+            const uint8_t *game =
+                run.Addr >= base ? _GameImage.GetData(run.Addr - base, run.Size) : nullptr;
+            if (game == nullptr || FindMismatch(game, run.OldBytes, run.Size) != run.Size)
+            {
+                AddImageWarning(path, "doesn't match the game code");
+                UnmapPatchImage();
+                return;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < image.GetPatchCount(); i++)
+    {
+        SPatchNode &node = _Nodes[nodes[i]];
+        if (!node.Enabled)
+            continue;
+        for (size_t j = 0; j < image.GetRunCount(i); j++)
+        {
+            auto run = image.GetRun(i, j);
+            Patcher::SChunkRef ref = {(uint8_t *)(uintptr_t)run.Addr, run.NewBytes, run.Size};
+            node.Writes.push_back(ref);
+        }
+        node.Prebuilt = true;
+    }
+}
+
+// Dependencies of the node must be checked before it
+static bool IsNodeEnabled(const SPatchNode &node)
+{
+    bool enabled = node.Desc->Enabled(PluginConfig);
+    for (auto it = node.Dependencies.cbegin(); it != node.Dependencies.cend(); ++it)
+        enabled = enabled && _Nodes[*it].Enabled;
+    return enabled && (GameVersion != nullptr || node.Desc->Ranges.empty());
+}
+
+void PreparePatches(const std::wstring &imagePath)
+{
+    int64_t start = StartupNow();
+    SortPatches();
+    if (_Nodes.empty())
+        return;
+
+    VERIFY(_GameImage.ParseModule(GetModuleHandleW(NULL)));
+    GameVersion = FindGameVersion(_GameImage);
+
+    // Disabled patches are still scheduled to release their dependents, but aren't called
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        SPatchNode &node = _Nodes[i];
+        node.Enabled = IsNodeEnabled(node);
+        if (GameVersion == nullptr && !node.Desc->Ranges.empty() &&
+            node.Desc->Enabled(PluginConfig))
+        {
+            PluginConfig.Warnings.push_back(std::string("Patch ") + node.Desc->Name +
+                                            " is disabled, the game build isn't supported");
+        }
+        node.PendingDependencies = (LONG)node.Dependencies.size();
+    }
+    if (!imagePath.empty())
+        LoadPatchImage(imagePath);
+
+    InitializeCriticalSection(&_ReadyLock);
+    _ReadySemaphore = CreateSemaphoreW(NULL, 0, LONG_MAX, NULL);
+    VERIFY(_ReadySemaphore != NULL);
+
+    // The caller takes patches too, so all of them are built even if no thread starts
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    size_t helpers = std::min((size_t)info.dwNumberOfProcessors, _Nodes.size()) - 1;
+    _WorkerCount = (LONG)helpers + 1;
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        if (_Nodes[i].Dependencies.empty())
+            PushReadyNode(i);
+    }
+    for (size_t i = 0; i < helpers; i++)
+    {
+        HANDLE thread = CreateThread(NULL, 0, PrepareThread, NULL, 0, NULL);
+        if (thread != NULL)
+            CloseHandle(thread);
+    }
+    PrepareReadyNodes();
+
+    CheckPatches();
+    StartupAddTime(SP_PREPARE_PATCHES, start);
+}
 
 // Below is a code to apply patches
 
-static DWORD _OldProtections[2];
-static char *_BaseAddr = (char *)0x400000;
+const uintptr_t PageSize = 4096;
+
+// Calls f(addr, data, size) for every run of chunk bytes which differ from the game memory
+template <class F>
+static void ForEachChangedRun(const Patcher::SChunkRef &chunk, F f)
+{
+    size_t offset = 0;
+    while (offset < chunk.Size)
+    {
+        offset += FindMismatch(chunk.Addr + offset, chunk.Data + offset, chunk.Size - offset);
+        if (offset == chunk.Size)
+            break;
+        size_t size = FindMatch(chunk.Addr + offset, chunk.Data + offset, chunk.Size - offset);
+        f(chunk.Addr + offset, chunk.Data + offset, size);
+        offset += size;
+    }
+}
+
+struct SUnlockedRange
+{
+    uint8_t *Addr;
+    size_t Size;
+    DWORD OldProtection;
+};
+
+static std::vector<SUnlockedRange> _UnlockedRanges;
+
+static void AddPages(const void *addr, size_t size, std::vector<uintptr_t> &pages)
+{
+    uintptr_t first = (uintptr_t)addr / PageSize;
+    uintptr_t last = ((uintptr_t)addr + size - 1) / PageSize;
+    for (uintptr_t page = first; page <= last; page++)
+        pages.push_back(page);
+}
+
+// Makes only the given pages writable. VirtualProtect returns the old protection of the first
+// page, so ranges are split where the protection changes
+static void UnlockPages(std::vector<uintptr_t> &pages)
+{
+    int64_t start = StartupNow();
+    std::sort(pages.begin(), pages.end());
+    pages.erase(std::unique(pages.begin(), pages.end()), pages.end());
+    for (size_t i = 0; i < pages.size();)
+    {
+        size_t next = i + 1;
+        while (next < pages.size() && pages[next] == pages[next - 1] + 1)
+            next++;
 
-static void GameMemLock()
+        auto addr = (uint8_t *)(pages[i] * PageSize);
+        auto end = (uint8_t *)((pages[next - 1] + 1) * PageSize);
+        while (addr < end)
+        {
+            MEMORY_BASIC_INFORMATION info;
+            VERIFY(VirtualQuery(addr, &info, sizeof(info)) != 0);
+            auto regionEnd = (uint8_t *)info.BaseAddress + info.RegionSize;
+            SUnlockedRange range = {addr, (size_t)(std::min(end, regionEnd) - addr), 0};
+            const DWORD executeMask = PAGE_EXECUTE | PAGE_EXECUTE_READ | PAGE_EXECUTE_READWRITE |
+                                      PAGE_EXECUTE_WRITECOPY;
+            bool executable = (info.Protect & executeMask) != 0;
+            if (!VirtualProtect(range.Addr, range.Size,
+                                executable ? PAGE_EXECUTE_READWRITE : PAGE_READWRITE,
+                                &range.OldProtection))
+            {
+                ErrorMsgBox(1, "Cannot unlock game memory at 0x%X. VirtualProtect failed: 0x%X",
+                            (unsigned)(uintptr_t)range.Addr, (unsigned)GetLastError());
+            }
+            _UnlockedRanges.push_back(range);
+            addr += range.Size;
+        }
+        i = next;
+    }
+    StartupAddTime(SP_MEM_UNLOCK, start);
+}
+
+static void LockPages()
 {
-    DWORD tmp;
-    // Lock .text
-    if (!VirtualProtect(_BaseAddr + 0x1000, 0x33A000, _OldProtections[0], &tmp))
-        ErrorMsgBox(1, "Cannot lock game .text section. VirtualProtect failed: 0x%X",
-                    (unsigned)GetLastError());
-    FlushInstructionCache(GetCurrentProcess(), _BaseAddr + 0x1000, 0x33A000);
-    // Lock .rdata
-    if (!VirtualProtect(_BaseAddr + 0x33B000, 0x48000, _OldProtections[1], &tmp))
-        ErrorMsgBox(1, "Cannot lock game .rdata section. VirtualProtect failed: 0x%X",
-                    (unsigned)GetLastError());
+    int64_t start = StartupNow();
+    for (auto it = _UnlockedRanges.cbegin(); it != _UnlockedRanges.cend(); ++it)
+    {
+        DWORD tmp;
+        if (!VirtualProtect(it->Addr, it->Size, it->OldProtection, &tmp))
+        {
+            ErrorMsgBox(1, "Cannot lock game memory at 0x%X. VirtualProtect failed: 0x%X",
+                        (unsigned)(uintptr_t)it->Addr, (unsigned)GetLastError());
+        }
+        FlushInstructionCache(GetCurrentProcess(), it->Addr, it->Size);
+    }
+    std::vector<SUnlockedRange>().swap(_UnlockedRanges);
+    StartupAddTime(SP_MEM_LOCK, start);
 }
 
-static void GameMemUnlock()
+// Checks bytes which patches expect before anything is written. Bytes of prebuilt patches were
+// checked when the patch image was loaded
+static void VerifyPatches()
 {
-    // Unlock .text
-    if (!VirtualProtect(_BaseAddr + 0x1000, 0x33A000, PAGE_EXECUTE_READWRITE, &_OldProtections[0]))
-        ErrorMsgBox(1, "Cannot unlock game .text section. VirtualProtect failed: 0x%X",
-                    (unsigned)GetLastError());
-    // Unlock .rdata
-    if (!VirtualProtect(_BaseAddr + 0x33B000, 0x48000, PAGE_READWRITE, &_OldProtections[1]))
-        ErrorMsgBox(1, "Cannot unlock game .rdata section. VirtualProtect failed: 0x%X",
-                    (unsigned)GetLastError());
+    int64_t start = StartupNow();
+    std::string mismatches;
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        const SPatchNode &node = _Nodes[i];
+        if (!node.Enabled)
+            continue;
+        for (auto it = node.Expected.cbegin(); it != node.Expected.cend(); ++it)
+        {
+            size_t offset = FindMismatch(it->Addr, it->Data, it->Size);
+            if (offset != it->Size)
+            {
+                char line[128];
+                sprintf_s(line, "\n%s at 0x%X", node.Desc->Name,
+                          (unsigned)(uintptr_t)(it->Addr + offset));
+                mismatches += line;
+            }
+        }
+    }
+    if (!mismatches.empty())
+    {
+        ErrorMsgBox(1, "Game code differs from the one expected by patches, the game version may "
+                       "be unsupported:%s",
+                    mismatches.c_str());
+    }
+    StartupAddTime(SP_VERIFY_PATCHES, start);
 }
 
+// Writing to a page of the game image makes a private copy of it, so bytes which already match
+// are skipped, e.g. when addon.dll made the same fix. Pages where nothing changes aren't even
+// unlocked
 void ApplyPatches()
 {
-    GameMemUnlock();
-    for (size_t i = 0; i < _countof(Patches); i++)
+    VerifyPatches();
+    bool countPatched = !PluginConfig.StartupReport.empty();
+    std::vector<uintptr_t> pages;
+    for (size_t i = 0; i < _Nodes.size(); i++)
     {
-        Patcher::SPatch patch;
-        if (!Patches[i](patch))
+        const SPatchNode &node = _Nodes[i];
+        if (!node.Enabled)
             continue; // Skip disabled patch
+        if (countPatched)
+            StartupAddPatched(node.Writes);
+
+        // Bytes which a later patch writes back to the original ones are counted too
+        for (auto it = node.Writes.cbegin(); it != node.Writes.cend(); ++it)
+        {
+            ForEachChangedRun(*it, [&pages](uint8_t *addr, const uint8_t *, size_t size) {
+                AddPages(addr, size, pages);
+            });
+        }
+    }
+    UnlockPages(pages);
+
+    // Bytes are copied straight from where they were built or from the mapped image. A patch
+    // may overwrite bytes of its dependencies, so they are compared again before writing.
+    // Other threads of the game may run already, so a vtable or IAT slot which differs in a
+    // few bytes is still stored as one aligned word
+    int64_t start = StartupNow();
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        SPatchNode &node = _Nodes[i];
+        if (!node.Enabled)
+            continue;
+        if (node.Desc->Reload != nullptr)
+            Patcher::BackupChunks(node.Writes, node.Backup);
+        for (auto it = node.Writes.cbegin(); it != node.Writes.cend(); ++it)
+        {
+            ForEachChangedRun(*it,
+                              [countPatched](uint8_t *addr, const uint8_t *data, size_t size) {
+                                  Patcher::StoreBytes(addr, data, size);
+                                  if (countPatched)
+                                      StartupAddModified(addr, size);
+                              });
+            SWriteRange range = {(uintptr_t)it->Addr, (uintptr_t)it->Addr + it->Size};
+            node.Written.push_back(range);
+        }
+        std::vector<Patcher::SChunkRef>().swap(node.Writes); // Free the memory
+        std::vector<Patcher::SChunkRef>().swap(node.Expected);
+        std::vector<Patcher::SPatchChunk>().swap(node.Prepared.Chunks);
+        std::vector<Patcher::SPatchChunk>().swap(node.Prepared.Expected);
+    }
+    UnmapPatchImage();
+    StartupAddTime(SP_APPLY_PATCHES, start);
+    LockPages();
+}
+
+// Runs the checks of startup for a rebuilt patch: it writes only inside its ranges and not over
+// unrelated patches, and the game has the bytes which it expects. Bytes under the previous
+// patch are compared with the original ones from its backup. Returns the problem or nullptr
+static const char *CheckReloadedPatch(size_t index, const Patcher::SPatch &patch)
+{
+    const SPatchNode &node = _Nodes[index];
+    for (auto it = patch.Chunks.cbegin(); it != patch.Chunks.cend(); ++it)
+    {
+        SWriteRange write = {(uintptr_t)it->Addr, (uintptr_t)it->Addr + it->Data.size()};
+        if (!IsInRanges(node, write))
+            return "writes outside of its declared ranges";
+        if (WritesSignature(write))
+            return "writes the signature of the game build";
+        for (size_t i = 0; i < _Nodes.size(); i++)
+        {
+            const SPatchNode &other = _Nodes[i];
+            if (i == index || !other.Enabled || _Related[index][i] || _Related[i][index])
+                continue;
+            for (auto w = other.Written.cbegin(); w != other.Written.cend(); ++w)
+            {
+                if (write.Addr < w->End && w->Addr < write.End)
+                    return "writes the same bytes as another patch";
+            }
+        }
+    }
+
+    std::map<const uint8_t *, uint8_t> original;
+    for (auto it = node.Backup.Chunks.cbegin(); it != node.Backup.Chunks.cend(); ++it)
+    {
+        for (size_t i = 0; i < it->Data.size(); i++)
+            original[it->Addr + i] = it->Data[i];
+    }
+    for (auto it = patch.Expected.cbegin(); it != patch.Expected.cend(); ++it)
+    {
+        for (size_t i = 0; i < it->Data.size(); i++)
+        {
+            const uint8_t *addr = it->Addr + i;
+            auto orig = original.find(addr);
+            if ((orig != original.end() ? orig->second : *addr) != it->Data[i])
+                return "expects other game bytes";
+        }
+    }
+    return nullptr;
+}
+
+static void AddReloadWarning(const SPatchNode &node, const char *text)
+{
+    std::string line = std::string("plugin.ini: Patch ") + node.Desc->Name + " " + text + "\n";
+    OutputDebugStringA(line.c_str());
+}
+
+// Dependents of a rebuilt patch are rebuilt too: they may use results of its functions or be
+// disabled with it. Dependencies come first, so they are rebuilt before.
+//
+// The game keeps running, so a patch is reapplied only if every instruction or pointer changes
+// with one store (see IsReapplyAtomic). Otherwise it keeps its bytes until the game restarts
+void ReloadPatches(const SPluginConfig &config)
+{
+    std::vector<bool> rebuilt(_Nodes.size(), false);
+    for (size_t i = 0; i < _Nodes.size(); i++)
+    {
+        SPatchNode &node = _Nodes[i];
+        if (node.Desc->Reload == nullptr)
+            continue;
+        bool changed = node.Desc->Reload(config);
+        for (auto it = node.Dependencies.cbegin(); it != node.Dependencies.cend(); ++it)
+            changed = changed || rebuilt[*it];
+        if (!changed)
+            continue; // Inputs are the same
+
+        // A disabled patch leaves the chunks empty, so the original bytes are restored
+        Patcher::SPatch patch;
+        bool enabled = IsNodeEnabled(node) && node.Desc->Apply(patch);
+        patch.Finish();
+        if (!enabled)
+            patch.Chunks.clear();
+
+        const char *problem = enabled ? CheckReloadedPatch(i, patch) : nullptr;
+        if (problem == nullptr && !Patcher::IsReapplyAtomic(patch, node.Backup))
+            problem = "can't be changed while the game runs, it's changed on restart";
+        if (problem != nullptr)
+        {
+            AddReloadWarning(node, problem);
+            continue;
+        }
+        node.Enabled = enabled;
+        rebuilt[i] = true;
 
+        // Only pages under the new and the previous patch are unlocked
+        std::vector<uintptr_t> pages;
+        node.Written.clear();
         for (auto it = patch.Chunks.cbegin(); it != patch.Chunks.cend(); ++it)
-            memcpy(it->Addr, &it->Data[0], it->Data.size());
+        {
+            if (!it->Data.empty())
+            {
+                AddPages(it->Addr, it->Data.size(), pages);
+                SWriteRange range = {(uintptr_t)it->Addr,
+                                     (uintptr_t)it->Addr + it->Data.size()};
+                node.Written.push_back(range);
+            }
+        }
+        for (auto it = node.Backup.Chunks.cbegin(); it != node.Backup.Chunks.cend(); ++it)
+        {
+            if (!it->Data.empty())
+                AddPages(it->Addr, it->Data.size(), pages);
+        }
+        UnlockPages(pages);
+        Patcher::ReapplyPatch(patch, node.Backup);
+        LockPages();
+        if (!enabled && node.Desc->Remove != nullptr)
+            node.Desc->Remove();
     }
-    GameMemLock();
 }
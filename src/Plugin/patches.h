@@ -1,3 +1,87 @@
 #pragma once
 
+#include "gameversion.h"
+#include "Shared/Patcher.h"
+#include <cstdint>
+#include <initializer_list>
+#include <string>
+#include <vector>
+
+struct SPluginConfig;
+
+typedef bool (*EnabledFunction)(const SPluginConfig &config);
+typedef bool (*PatchFunction)(Patcher::SPatch &patch);
+typedef bool (*ReloadFunction)(const SPluginConfig &config);
+typedef void (*RemoveFunction)();
+
+// Game memory written by a patch
+struct SPatchRange
+{
+    EGameAddress Addr;
+    uint32_t Size;
+};
+
+//
+// A patch registered with REGISTER_PATCH.
+//
+// Patches are applied in the order of dependencies, a patch is skipped if it or any of its
+// dependencies is disabled or fails to build. Dependents of a reloadable patch must be
+// reloadable, they are rebuilt with it. Patches which don't depend on each other are built in
+// parallel and must not write the same bytes. Ranges may be empty if the addresses come from
+// config, otherwise a patch can write only inside them. Patches with ranges use addresses of the
+// game build, they are disabled if the build isn't supported.
+//
+// Reload functions run on the config watcher thread while the game runs. They copy the
+// reloaded settings into PluginConfig, which only they read after startup; a value used by
+// other threads is published with an atomic store. A rebuilt patch is checked like at startup
+// and is written only if every chunk changes inside one aligned word, so no thread sees a half
+// written instruction. Other changes are refused with a warning and wait for a restart.
+//
+// Bytes of a static patch depend only on the game exe and config, so it can be built offline
+// by patchc into a patch image. Patches which create hooks or refer to plugin data aren't static.
+//
+struct SPatchDesc
+{
+    const char *Name;
+    EnabledFunction Enabled;
+    PatchFunction Apply;
+    ReloadFunction Reload; // nullptr if the patch can't be reapplied at runtime
+    RemoveFunction Remove; // Frees resources of Apply after a reload restored the game bytes
+    std::vector<SPatchRange> Ranges;
+    std::vector<const char *> Dependencies; // Names of patches
+    bool Static;
+
+    SPatchDesc *Next;
+    static SPatchDesc *First;
+
+    SPatchDesc(const char *name, EnabledFunction enabled, PatchFunction apply,
+               ReloadFunction reload, std::initializer_list<SPatchRange> ranges,
+               std::initializer_list<const char *> dependencies, bool isStatic = false,
+               RemoveFunction remove = nullptr)
+        : Name(name)
+        , Enabled(enabled)
+        , Apply(apply)
+        , Reload(reload)
+        , Remove(remove)
+        , Ranges(ranges)
+        , Dependencies(dependencies)
+        , Static(isStatic)
+        , Next(First)
+    {
+        First = this;
+    }
+};
+
+// Declares a patch at file scope:
+// REGISTER_PATCH(PK, PKEnabled, PKPatch, PKReload, {{GA_PK_JUMP, 1}}, {}, true);
+#define REGISTER_PATCH(name, ...) static SPatchDesc _PatchDesc##name(#name, __VA_ARGS__)
+
+// Builds all enabled patches without writing them, may be called from any thread. Static
+// patches are taken from the patch image if it's set and matches the game exe and config
+void PreparePatches(const std::wstring &imagePath);
+
+// Writes patches built by PreparePatches, only bytes which differ from the game ones
 void ApplyPatches();
+
+// Reapplies patches whose inputs differ in the reloaded config, called by the config watcher
+void ReloadPatches(const SPluginConfig &config);
@@ -0,0 +1,118 @@
+#include "reload.h"
+#include "config.h"
+#include "configcache.h"
+#include "patches.h"
+#include "Shared/Common.h"
+#include <windows.h>
+
+namespace {
+
+const DWORD SettleDelayMs = 200; // Editors may write a file in several steps
+const DWORD StopTimeoutMs = 1000;
+
+class CConfigWatcher
+{
+public:
+    CConfigWatcher()
+        : _change(INVALID_HANDLE_VALUE)
+        , _thread(NULL)
+        , _stopEvent(NULL)
+    {
+        _lastWrite.dwLowDateTime = 0;
+        _lastWrite.dwHighDateTime = 0;
+    }
+
+    bool Start(const std::wstring &configPath)
+    {
+        _path = configPath;
+        GetLastWriteTime(_lastWrite);
+
+        _change = FindFirstChangeNotificationW(Common::GetDirectoryName(configPath).c_str(), FALSE,
+                                               FILE_NOTIFY_CHANGE_LAST_WRITE |
+                                                   FILE_NOTIFY_CHANGE_FILE_NAME);
+        if (_change == INVALID_HANDLE_VALUE)
+            return false;
+        _stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+        if (_stopEvent == NULL)
+            return false;
+
+        _thread = CreateThread(NULL, 0, WatchThread, this, 0, NULL);
+        if (_thread == NULL)
+            return false;
+        SetThreadPriority(_thread, THREAD_PRIORITY_BELOW_NORMAL);
+        return true;
+    }
+
+    void Stop()
+    {
+        if (_thread == NULL)
+            return;
+        SetEvent(_stopEvent);
+        WaitForSingleObject(_thread, StopTimeoutMs);
+        CloseHandle(_thread);
+        CloseHandle(_stopEvent);
+        FindCloseChangeNotification(_change);
+        _thread = NULL;
+        _stopEvent = NULL;
+        _change = INVALID_HANDLE_VALUE;
+    }
+
+private:
+    std::wstring _path;
+    FILETIME _lastWrite;
+    HANDLE _change;
+    HANDLE _thread;
+    HANDLE _stopEvent;
+
+    bool GetLastWriteTime(FILETIME &time) const
+    {
+        WIN32_FILE_ATTRIBUTE_DATA data;
+        if (!GetFileAttributesExW(_path.c_str(), GetFileExInfoStandard, &data))
+            return false;
+        time = data.ftLastWriteTime;
+        return true;
+    }
+
+    static DWORD WINAPI WatchThread(LPVOID param)
+    {
+        auto self = (CConfigWatcher *)param;
+        HANDLE handles[] = {self->_stopEvent, self->_change};
+        while (WaitForMultipleObjects(_countof(handles), handles, FALSE, INFINITE) ==
+               WAIT_OBJECT_0 + 1)
+        {
+            if (WaitForSingleObject(self->_stopEvent, SettleDelayMs) == WAIT_OBJECT_0)
+                break;
+
+            // Rearm before reading, so a write during the reload isn't missed
+            if (!FindNextChangeNotification(self->_change))
+                break;
+
+            // Other files in the directory are changed too
+            FILETIME time;
+            if (!self->GetLastWriteTime(time) || CompareFileTime(&time, &self->_lastWrite) == 0)
+                continue;
+            self->_lastWrite = time;
+
+            SPluginConfig config;
+            LoadConfig(config, self->_path);
+            for (size_t i = 0; i < config.Warnings.size(); i++)
+                OutputDebugStringA(("plugin.ini: " + config.Warnings[i] + "\n").c_str());
+            ReloadPatches(config);
+        }
+        return 0;
+    }
+};
+
+} // namespace
+
+static CConfigWatcher watcher;
+
+bool ConfigWatchStart(const std::wstring &configPath)
+{
+    return watcher.Start(configPath);
+}
+
+void ConfigWatchStop()
+{
+    watcher.Stop();
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <string>
+
+//
+// Hot reload of plugin.ini.
+//
+// A thread waits for a change notification of the plugin directory, so it
+// doesn't run until some file there is written. When the config file itself
+// is changed, it's parsed again and only the patches whose settings differ are
+// reapplied (see ReloadPatches).
+//
+
+bool ConfigWatchStart(const std::wstring &configPath);
+void ConfigWatchStop();
@@ -0,0 +1,109 @@
+#include "startup.h"
+#include "Shared/Common.h"
+#include "Shared/Hook.h"
+#include <set>
+#include <windows.h>
+
+using namespace Common;
+
+const size_t MaxStartupPatches = 64;
+const uintptr_t PageSize = 4096;
+
+struct SPatchTime
+{
+    const char *Name;
+    int64_t Time;
+};
+
+static const char *const PhaseNames[SP_COUNT] = {
+    "DllMain",          "Config load",      "Patches build",     "EntryBeforePatch",
+    "  Wait for build", "  Patches verify", "  Game mem unlock", "  Patches write",
+    "  Game mem lock",
+};
+
+static int64_t PhaseTimes[SP_COUNT];
+static SPatchTime PatchTimes[MaxStartupPatches];
+static size_t PatchedBytes = 0;
+static std::set<uintptr_t> PatchedPages;
+static size_t ModifiedBytes = 0;
+static std::set<uintptr_t> ModifiedPages;
+
+int64_t StartupNow()
+{
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+void StartupAddTime(EStartupPhase phase, int64_t start)
+{
+    PhaseTimes[phase] += StartupNow() - start;
+}
+
+void StartupAddPatchTime(size_t index, const char *name, int64_t start)
+{
+    if (index >= MaxStartupPatches)
+        return;
+    PatchTimes[index].Name = name;
+    PatchTimes[index].Time += StartupNow() - start;
+}
+
+void StartupAddPatched(const std::vector<Patcher::SChunkRef> &chunks)
+{
+    for (auto it = chunks.cbegin(); it != chunks.cend(); ++it)
+    {
+        PatchedBytes += it->Size;
+        uintptr_t first = (uintptr_t)it->Addr / PageSize;
+        uintptr_t last = ((uintptr_t)it->Addr + it->Size - 1) / PageSize;
+        for (uintptr_t page = first; page <= last; page++)
+            PatchedPages.insert(page);
+    }
+}
+
+void StartupAddModified(const void *addr, size_t size)
+{
+    ModifiedBytes += size;
+    uintptr_t first = (uintptr_t)addr / PageSize;
+    uintptr_t last = ((uintptr_t)addr + size - 1) / PageSize;
+    for (uintptr_t page = first; page <= last; page++)
+        ModifiedPages.insert(page);
+}
+
+void WriteStartupReport(const std::wstring &filename)
+{
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    double ticksPerUs = freq.QuadPart / 1e6;
+
+    std::string report;
+    char line[256];
+    sprintf_s(line, "%-20s %12s\r\n", "Phase", "Time (us)");
+    report += line;
+    for (size_t i = 0; i < SP_COUNT; i++)
+    {
+        sprintf_s(line, "%-20s %12.1f\r\n", PhaseNames[i], PhaseTimes[i] / ticksPerUs);
+        report += line;
+    }
+
+    sprintf_s(line, "\r\n%-20s %12s\r\n", "Patch", "Time (us)");
+    report += line;
+    for (size_t i = 0; i < MaxStartupPatches; i++)
+    {
+        if (PatchTimes[i].Name == nullptr)
+            continue;
+        sprintf_s(line, "%-20s %12.1f\r\n", PatchTimes[i].Name, PatchTimes[i].Time / ticksPerUs);
+        report += line;
+    }
+
+    SimpleHooker86::SHookStats hooks;
+    SimpleHooker86::GetHookStats(hooks);
+    sprintf_s(line,
+              "\r\nPatched: %u bytes in %u pages, modified: %u bytes in %u pages\r\n"
+              "Hooks: %u, helpers code: %u bytes in %.1f us\r\n",
+              (unsigned)PatchedBytes, (unsigned)PatchedPages.size(), (unsigned)ModifiedBytes,
+              (unsigned)ModifiedPages.size(), hooks.HookCount,
+              (unsigned)hooks.ArenaBytes, hooks.ArenaTime / ticksPerUs);
+    report += line;
+
+    WriteFileFull(filename, report);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Shared/Patcher.h"
+#include <cstdint>
+#include <string>
+
+//
+// Timing of the plugin startup.
+//
+// Phases are always measured, it costs a couple of QueryPerformanceCounter
+// calls per phase. Patched bytes and pages are counted only if the report is
+// enabled in config. The report is written at the end of EntryAfterPatch.
+//
+
+enum EStartupPhase
+{
+    SP_DLL_MAIN,
+    SP_CONFIG_LOAD,
+    SP_PREPARE_PATCHES, // All patches, they are built in parallel
+    SP_ENTRY_BEFORE_PATCH,
+    SP_WAIT_PREPARED, // Part of EntryBeforePatch
+    SP_VERIFY_PATCHES,
+    SP_MEM_UNLOCK,
+    SP_APPLY_PATCHES,
+    SP_MEM_LOCK,
+    SP_COUNT
+};
+
+int64_t StartupNow();
+
+// Adds the time since start to the phase
+void StartupAddTime(EStartupPhase phase, int64_t start);
+
+// Time of building one of patches, they may be built on different threads
+void StartupAddPatchTime(size_t index, const char *name, int64_t start);
+
+void StartupAddPatched(const std::vector<Patcher::SChunkRef> &chunks);
+// Game bytes which differed and were written
+void StartupAddModified(const void *addr, size_t size);
+
+void WriteStartupReport(const std::wstring &filename);
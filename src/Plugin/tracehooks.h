@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+// Ids of hooks in the trace file. Timing hooks of [Latency] functions take ids from
+// TH_LATENCY on, in the order of the functions
+enum ETraceHook : uint16_t
+{
+    TH_MALLOC = 1,
+    TH_FREE,
+    TH_REALLOC,
+    TH_MSIZE,
+    TH_FRAME_PACER,
+    TH_EXPAND,
+    TH_RECALLOC,
+    TH_FREE_BASE,
+    TH_LATENCY = 0x100,
+};
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "Shared/Patcher.h"
+#include <cstdint>
+#include <cstring>
+
+//
+// Small typed x86 assembler for patches and generated helpers.
+//
+// Instructions are encoded at runtime with plain stores into a buffer of fixed
+// capacity (usually on the stack), and the whole sequence is copied with one
+// memcpy. Nothing is encoded at compile time. An overflow of the buffer only
+// makes the code invalid, Write returns 0 for it. Call and jump targets are
+// absolute addresses, their rel32 offsets are resolved when the code is copied
+// to its final address. Labels allow jumps inside the code.
+//
+// Usage:
+//   Asm::CAssembler<64> a;
+//   a.Push(RN_EBP).Mov(RN_EBP, RN_ESP).Push(Asm::Mem(RN_EBP, 8)).Call(func);
+//   a.Leave().Ret();
+//   addr += a.Write(addr);
+//
+
+namespace Asm {
+
+using Patcher::ERegisterName;
+
+// Memory operand: dword [Base + Disp]
+struct SMem
+{
+    ERegisterName Base;
+    int32_t Disp;
+};
+
+static inline SMem Mem(ERegisterName base, int32_t disp = 0)
+{
+    SMem result = {base, disp};
+    return result;
+}
+
+// Condition codes of jcc
+enum ECondition : uint8_t
+{
+    CN_O = 0x0,
+    CN_NO = 0x1,
+    CN_B = 0x2,
+    CN_AE = 0x3,
+    CN_E = 0x4,
+    CN_NE = 0x5,
+    CN_BE = 0x6,
+    CN_A = 0x7,
+    CN_S = 0x8,
+    CN_NS = 0x9,
+    CN_L = 0xC,
+    CN_GE = 0xD,
+    CN_LE = 0xE,
+    CN_G = 0xF,
+};
+
+struct SLabel
+{
+    size_t Index;
+};
+
+const size_t MaxLabels = 16;
+const size_t MaxFixups = 32;
+
+class CAssemblerBase
+{
+public:
+    size_t GetSize() const { return _size; }
+
+    // False if the buffer overflowed or a jump refers to an unbound or too far label
+    bool IsValid() const
+    {
+        if (_overflow)
+            return false;
+        for (size_t i = 0; i < _fixupCount; i++)
+        {
+            const SFixup &fixup = _fixups[i];
+            if (fixup.Kind == FK_ABSOLUTE)
+                continue;
+            if (_labels[fixup.Label] == NoOffset)
+                return false;
+            intptr_t delta = GetLabelDelta(fixup);
+            if (fixup.Kind == FK_REL8 && (delta < -128 || delta > 127))
+                return false;
+        }
+        return true;
+    }
+
+    // Copies the code to its final address, returns its size or 0 if the code isn't valid
+    size_t Write(void *addr) const
+    {
+        if (!Resolve(addr))
+            return 0;
+        memcpy(addr, _code, _size);
+        return _size;
+    }
+
+    size_t Write(Patcher::SPatch &patch, void *addr) const
+    {
+        if (!Resolve(addr))
+            return 0;
+        return patch.Write(addr, _code, _size);
+    }
+
+    SLabel NewLabel()
+    {
+        SLabel result = {_labelCount};
+        if (_labelCount < MaxLabels)
+            _labels[_labelCount++] = NoOffset;
+        else
+            _overflow = true;
+        return result;
+    }
+
+    CAssemblerBase &Bind(SLabel label)
+    {
+        if (label.Index < _labelCount)
+            _labels[label.Index] = _size;
+        return *this;
+    }
+
+    // clang-format off
+    CAssemblerBase &Push(ERegisterName reg)                 { return Byte(0x50 + reg); }
+    CAssemblerBase &Push(uint32_t value)                    { return Byte(0x68).Dword(value); }
+    CAssemblerBase &Push(SMem mem)                          { return Byte(0xFF).ModRm(6, mem); }
+    CAssemblerBase &Pop(ERegisterName reg)                  { return Byte(0x58 + reg); }
+    CAssemblerBase &Pushad()                                { return Byte(0x60); }
+    CAssemblerBase &Popad()                                 { return Byte(0x61); }
+    CAssemblerBase &Pushfd()                                { return Byte(0x9C); }
+    CAssemblerBase &Popfd()                                 { return Byte(0x9D); }
+
+    CAssemblerBase &Mov(ERegisterName dst, ERegisterName src) { return Byte(0x89).ModRm(src, dst); }
+    CAssemblerBase &Mov(ERegisterName dst, uint32_t value)  { return Byte(0xB8 + dst).Dword(value); }
+    CAssemblerBase &Mov(ERegisterName dst, SMem src)        { return Byte(0x8B).ModRm(dst, src); }
+    CAssemblerBase &Mov(SMem dst, ERegisterName src)        { return Byte(0x89).ModRm(src, dst); }
+    CAssemblerBase &Lea(ERegisterName dst, SMem src)        { return Byte(0x8D).ModRm(dst, src); }
+    CAssemblerBase &Xchg(SMem dst, ERegisterName src)       { return Byte(0x87).ModRm(src, dst); }
+
+    CAssemblerBase &Add(ERegisterName dst, int32_t value)   { return Arith(0, dst, value); }
+    CAssemblerBase &Add(ERegisterName dst, ERegisterName src) { return Byte(0x01).ModRm(src, dst); }
+    CAssemblerBase &Add(ERegisterName dst, SMem src)        { return Byte(0x03).ModRm(dst, src); }
+    CAssemblerBase &Sub(ERegisterName dst, int32_t value)   { return Arith(5, dst, value); }
+    CAssemblerBase &Cmp(ERegisterName dst, int32_t value)   { return Arith(7, dst, value); }
+    CAssemblerBase &Test(ERegisterName dst, ERegisterName src) { return Byte(0x85).ModRm(src, dst); }
+
+    CAssemblerBase &Call(const void *target)                { return Byte(0xE8).Absolute(target); }
+    CAssemblerBase &Call(ERegisterName reg)                 { return Byte(0xFF).ModRm(2, reg); }
+    CAssemblerBase &Jmp(const void *target)                 { return Byte(0xE9).Absolute(target); }
+    CAssemblerBase &Jmp(ERegisterName reg)                  { return Byte(0xFF).ModRm(4, reg); }
+    CAssemblerBase &Jmp(SMem mem)                           { return Byte(0xFF).ModRm(4, mem); }
+    CAssemblerBase &Jmp(SLabel label)                       { return Byte(0xE9).Rel32(label); }
+    CAssemblerBase &JmpShort(SLabel label)                  { return Byte(0xEB).Rel8(label); }
+    CAssemblerBase &Jcc(ECondition cond, SLabel label)      { return Byte(0x0F).Byte(0x80 + cond).Rel32(label); }
+    CAssemblerBase &JccShort(ECondition cond, SLabel label) { return Byte(0x70 + cond).Rel8(label); }
+    CAssemblerBase &Leave()                                 { return Byte(0xC9); }
+    CAssemblerBase &Ret()                                   { return Byte(0xC3); }
+    CAssemblerBase &Ret(uint16_t argsSize)                  { return Byte(0xC2).Word(argsSize); }
+    CAssemblerBase &Nops(size_t count)                      { while (count--) Byte(0x90); return *this; }
+    // clang-format on
+
+    // Raw bytes, e.g. original instructions moved by a hook. They must not
+    // contain relative offsets
+    CAssemblerBase &Bytes(const void *data, size_t size)
+    {
+        if (!Reserve(size))
+            return *this;
+        memcpy(_code + _size, data, size);
+        _size += size;
+        return *this;
+    }
+
+protected:
+    CAssemblerBase(uint8_t *code, size_t capacity)
+        : _code(code)
+        , _capacity(capacity)
+        , _size(0)
+        , _labelCount(0)
+        , _fixupCount(0)
+        , _overflow(false)
+    {
+    }
+
+private:
+    static const size_t NoOffset = (size_t)-1;
+
+    enum EFixupKind : uint8_t
+    {
+        FK_ABSOLUTE, // rel32 to an absolute address
+        FK_REL32,    // rel32 to a label
+        FK_REL8,     // rel8 to a label
+    };
+
+    struct SFixup
+    {
+        EFixupKind Kind;
+        size_t Offset; // Offset of the rel field, the instruction ends right after it
+        size_t Label;
+        const void *Target;
+    };
+
+    uint8_t *_code;
+    size_t _capacity;
+    size_t _size;
+    size_t _labelCount;
+    size_t _fixupCount;
+    bool _overflow;
+    size_t _labels[MaxLabels];
+    SFixup _fixups[MaxFixups];
+
+    CAssemblerBase(const CAssemblerBase &);
+    CAssemblerBase &operator=(const CAssemblerBase &);
+
+    bool Reserve(size_t size)
+    {
+        if (_size + size > _capacity)
+            _overflow = true;
+        return !_overflow;
+    }
+
+    CAssemblerBase &Byte(int value)
+    {
+        if (Reserve(1))
+            _code[_size++] = (uint8_t)value;
+        return *this;
+    }
+
+    CAssemblerBase &Word(uint16_t value)
+    {
+        return Bytes(&value, sizeof(value));
+    }
+
+    CAssemblerBase &Dword(uint32_t value)
+    {
+        return Bytes(&value, sizeof(value));
+    }
+
+    // Register operand
+    CAssemblerBase &ModRm(int reg, ERegisterName rm)
+    {
+        return Byte(0xC0 | reg << 3 | rm);
+    }
+
+    CAssemblerBase &ModRm(int reg, SMem mem)
+    {
+        // [ebp] can only be encoded with a displacement, [esp] needs SIB
+        int mod = 2;
+        if (mem.Disp == 0 && mem.Base != Patcher::RN_EBP)
+            mod = 0;
+        else if (mem.Disp >= -128 && mem.Disp <= 127)
+            mod = 1;
+        Byte(mod << 6 | reg << 3 | mem.Base);
+        if (mem.Base == Patcher::RN_ESP)
+            Byte(0x24);
+        if (mod == 1)
+            Byte((int8_t)mem.Disp);
+        else if (mod == 2)
+            Dword((uint32_t)mem.Disp);
+        return *this;
+    }
+
+    CAssemblerBase &Arith(int op, ERegisterName dst, int32_t value)
+    {
+        if (value >= -128 && value <= 127)
+            return Byte(0x83).ModRm(op, dst).Byte((int8_t)value);
+        return Byte(0x81).ModRm(op, dst).Dword((uint32_t)value);
+    }
+
+    CAssemblerBase &AddFixup(EFixupKind kind, size_t label, const void *target, size_t size)
+    {
+        if (_fixupCount == MaxFixups)
+        {
+            _overflow = true;
+            return *this;
+        }
+        SFixup &fixup = _fixups[_fixupCount++];
+        fixup.Kind = kind;
+        fixup.Offset = _size;
+        fixup.Label = label;
+        fixup.Target = target;
+        uint32_t zero = 0;
+        return Bytes(&zero, size);
+    }
+
+    CAssemblerBase &Absolute(const void *target) { return AddFixup(FK_ABSOLUTE, 0, target, 4); }
+
+    CAssemblerBase &Rel32(SLabel label) { return AddFixup(FK_REL32, label.Index, nullptr, 4); }
+
+    CAssemblerBase &Rel8(SLabel label) { return AddFixup(FK_REL8, label.Index, nullptr, 1); }
+
+    intptr_t GetLabelDelta(const SFixup &fixup) const
+    {
+        size_t end = fixup.Offset + (fixup.Kind == FK_REL8 ? 1 : 4);
+        return (intptr_t)_labels[fixup.Label] - (intptr_t)end;
+    }
+
+    // Labels are resolved in place, absolute targets depend on the final address
+    bool Resolve(const void *addr) const
+    {
+        if (!IsValid())
+            return false;
+
+        for (size_t i = 0; i < _fixupCount; i++)
+        {
+            const SFixup &fixup = _fixups[i];
+            if (fixup.Kind == FK_ABSOLUTE)
+            {
+                int32_t delta =
+                    Patcher::AddrDelta((const char *)addr + fixup.Offset, fixup.Target, 4);
+                memcpy(_code + fixup.Offset, &delta, sizeof(delta));
+            }
+            else if (fixup.Kind == FK_REL8)
+                _code[fixup.Offset] = (uint8_t)(int8_t)GetLabelDelta(fixup);
+            else
+            {
+                auto delta = (int32_t)GetLabelDelta(fixup);
+                memcpy(_code + fixup.Offset, &delta, sizeof(delta));
+            }
+        }
+        return true;
+    }
+};
+
+template <size_t Capacity>
+class CAssembler : public CAssemblerBase
+{
+public:
+    CAssembler()
+        : CAssemblerBase(_buffer, Capacity)
+    {
+    }
+
+private:
+    uint8_t _buffer[Capacity];
+};
+
+} // namespace Asm
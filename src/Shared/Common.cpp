@@ -330,6 +330,38 @@ bool Common::WriteFileFull(const wstring &filename, const string &value)
     return WriteFileFull(filename, value.c_str(), value.length());
 }
 
+const void *Common::MapFileForRead(const wstring &filename, size_t &size)
+{
+    HANDLE hFile = CreateFileW(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                               NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (hFile == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+    const void *view = nullptr;
+    LARGE_INTEGER largeSize;
+    if (GetFileSizeEx(hFile, &largeSize) && largeSize.QuadPart > 0 &&
+        largeSize.QuadPart <= MAXDWORD)
+    {
+        // The view keeps the mapping alive, so both handles are closed here
+        HANDLE hMapping = CreateFileMappingW(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (hMapping != NULL)
+        {
+            view = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(hMapping);
+        }
+    }
+    CloseHandle(hFile);
+
+    size = view != nullptr ? (size_t)largeSize.QuadPart : 0;
+    return view;
+}
+
+void Common::UnmapFile(const void *view)
+{
+    if (view != nullptr)
+        UnmapViewOfFile(view);
+}
+
 static string GetFileDescription(const void *block)
 {
     struct LANGANDCODEPAGE
@@ -488,24 +520,3 @@ void Common::ErrorMsgBox(UINT exitCode, const char *format, ...)
     if (exitCode != 0)
         ExitProcess(exitCode);
 }
-
-static uint32_t Crc32ForByte(uint32_t b)
-{
-    for (int i = 0; i < 8; i++)
-        b = (b & 1 ? 0 : (uint32_t)0xEDB88320ul) ^ b >> 1;
-    return b ^ (uint32_t)0xFF000000ul;
-}
-
-uint32_t Common::GetCrc32(const void *data, size_t size, uint32_t crc)
-{
-    static uint32_t table[0x100];
-    if (!*table)
-    {
-        for (size_t i = 0; i < 256; i++)
-            table[i] = Crc32ForByte(i);
-    }
-
-    for (size_t i = 0; i < size; i++)
-        crc = table[(uint8_t)crc ^ ((uint8_t *)data)[i]] ^ crc >> 8;
-    return crc;
-}
@@ -72,6 +72,11 @@ bool WriteFileFull(const std::wstring &filename, const void *data, size_t size);
 bool WriteFileFull(const std::wstring &filename, const std::string &value);
 bool WriteFileFull(const std::wstring &filename, const std::vector<char> &value);
 
+// Maps the whole file read-only, the view stays valid until UnmapFile. Returns nullptr for an
+// empty file or on failure
+const void *MapFileForRead(const std::wstring &filename, size_t &size);
+void UnmapFile(const void *view);
+
 static inline bool FileExists(const std::wstring &filename)
 {
     DWORD attrs = GetFileAttributesW(filename.c_str());
@@ -113,6 +118,12 @@ void ErrorMsgBox(UINT exitCode, const char *format, ...);
 std::wstring GetCurrentModulePath();
 uint32_t GetCrc32(const void *data, size_t size, uint32_t crc = 0);
 
+// Offset of the first byte which differs in a and b, or size if there is none. Compares 16 bytes
+// at once with SSE2 when the CPU has it
+size_t FindMismatch(const void *a, const void *b, size_t size);
+// Offset of the first byte which is the same in a and b, or size if there is none
+size_t FindMatch(const void *a, const void *b, size_t size);
+
 // Just an assert which will always compile (not debug only)
 #define VERIFY(cond) \
     if (!(cond)) {   \
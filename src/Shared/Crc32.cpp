@@ -0,0 +1,22 @@
+#include "Common.h"
+
+static uint32_t Crc32ForByte(uint32_t b)
+{
+    for (int i = 0; i < 8; i++)
+        b = (b & 1 ? 0 : (uint32_t)0xEDB88320ul) ^ b >> 1;
+    return b ^ (uint32_t)0xFF000000ul;
+}
+
+uint32_t Common::GetCrc32(const void *data, size_t size, uint32_t crc)
+{
+    static uint32_t table[0x100];
+    if (!*table)
+    {
+        for (size_t i = 0; i < 256; i++)
+            table[i] = Crc32ForByte(i);
+    }
+
+    for (size_t i = 0; i < size; i++)
+        crc = table[(uint8_t)crc ^ ((uint8_t *)data)[i]] ^ crc >> 8;
+    return crc;
+}
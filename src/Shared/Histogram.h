@@ -0,0 +1,199 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//
+// Log-linear (HDR-style) histogram of 64-bit values.
+//
+// Values below SubBucketCount are counted exactly. Larger values fall into
+// one of SubBucketCount / 2 linear sub-buckets of their power of two range,
+// so the relative error of any reported value is below 2 / SubBucketCount.
+//
+
+namespace Stats {
+
+const unsigned SubBucketBits = 5;
+const unsigned SubBucketCount = 1 << SubBucketBits;
+const unsigned HalfSubBucketCount = SubBucketCount / 2;
+const size_t BucketCount = (64 - SubBucketBits + 1) * HalfSubBucketCount + HalfSubBucketCount;
+
+// The value must not be 0. 32-bit MSVC has no 64-bit bit scan, so the halves are scanned
+static inline unsigned HighestBit(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    if (_BitScanReverse(&index, (unsigned long)(value >> 32)))
+        return (unsigned)index + 32;
+    _BitScanReverse(&index, (unsigned long)value);
+    return (unsigned)index;
+#else
+    return 63 - (unsigned)__builtin_clzll(value);
+#endif
+}
+
+static inline size_t GetBucketIndex(uint64_t value)
+{
+    if (value < SubBucketCount)
+        return (size_t)value;
+    unsigned shift = HighestBit(value) - SubBucketBits + 1;
+    return shift * HalfSubBucketCount + (size_t)(value >> shift);
+}
+
+static inline uint64_t GetBucketLowest(size_t index)
+{
+    if (index < SubBucketCount)
+        return index;
+    unsigned shift = (unsigned)(index / HalfSubBucketCount) - 1;
+    return (uint64_t)(index - shift * HalfSubBucketCount) << shift;
+}
+
+static inline uint64_t GetBucketHighest(size_t index)
+{
+    if (index < SubBucketCount)
+        return index;
+    unsigned shift = (unsigned)(index / HalfSubBucketCount) - 1;
+    return GetBucketLowest(index) + ((uint64_t)1 << shift) - 1;
+}
+
+struct SHistogram
+{
+    uint64_t Count;
+    uint64_t Sum;
+    uint64_t Min;
+    uint64_t Max;
+    uint32_t Buckets[BucketCount];
+
+    SHistogram() { Reset(); }
+
+    void Reset()
+    {
+        Count = 0;
+        Sum = 0;
+        Min = UINT64_MAX;
+        Max = 0;
+        memset(Buckets, 0, sizeof(Buckets));
+    }
+
+    void Record(uint64_t value)
+    {
+        Buckets[GetBucketIndex(value)]++;
+        Count++;
+        Sum += value;
+        if (value < Min)
+            Min = value;
+        if (value > Max)
+            Max = value;
+    }
+
+    void Merge(const SHistogram &other)
+    {
+        for (size_t i = 0; i < BucketCount; i++)
+            Buckets[i] += other.Buckets[i];
+        Count += other.Count;
+        Sum += other.Sum;
+        if (other.Min < Min)
+            Min = other.Min;
+        if (other.Max > Max)
+            Max = other.Max;
+    }
+
+    // Returns the highest value of the bucket which contains the specified
+    // percentile (0..100) of recorded values
+    uint64_t GetPercentile(double percentile) const
+    {
+        if (Count == 0)
+            return 0;
+        auto rank = (uint64_t)(percentile / 100.0 * Count + 0.5);
+        if (rank < 1)
+            rank = 1;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BucketCount; i++)
+        {
+            seen += Buckets[i];
+            if (seen >= rank)
+                return GetBucketHighest(i) < Max ? GetBucketHighest(i) : Max;
+        }
+        return Max;
+    }
+
+    double GetMean() const { return Count != 0 ? (double)Sum / Count : 0.0; }
+};
+
+#ifdef _MSC_VER
+static inline void AtomicIncrement(volatile long *value)
+{
+    _InterlockedIncrement(value);
+}
+
+static inline int64_t AtomicCompareExchange(volatile int64_t *value, int64_t exchange,
+                                            int64_t comparand)
+{
+    return _InterlockedCompareExchange64((volatile __int64 *)value, exchange, comparand);
+}
+#else
+static inline void AtomicIncrement(volatile long *value)
+{
+    __sync_fetch_and_add(value, 1);
+}
+
+static inline int64_t AtomicCompareExchange(volatile int64_t *value, int64_t exchange,
+                                            int64_t comparand)
+{
+    return __sync_val_compare_and_swap(value, comparand, exchange);
+}
+#endif
+
+// Histogram which can be updated from many threads at once without locks.
+// Count and Min are derived from the buckets when a snapshot is taken.
+struct SAtomicHistogram
+{
+    volatile int64_t Sum;
+    volatile int64_t Max;
+    volatile long Buckets[BucketCount];
+
+    SAtomicHistogram() { Reset(); }
+
+    void Reset()
+    {
+        Sum = 0;
+        Max = 0;
+        memset((void *)Buckets, 0, sizeof(Buckets));
+    }
+
+    void Record(uint64_t value)
+    {
+        AtomicIncrement(&Buckets[GetBucketIndex(value)]);
+
+        int64_t prev = Sum;
+        int64_t cur;
+        while ((cur = AtomicCompareExchange(&Sum, prev + (int64_t)value, prev)) != prev)
+            prev = cur;
+
+        prev = Max;
+        while (prev < (int64_t)value &&
+               (cur = AtomicCompareExchange(&Max, (int64_t)value, prev)) != prev)
+            prev = cur;
+    }
+
+    // Copies the histogram. Values recorded during the copy may be partially lost
+    void Snapshot(SHistogram &result) const
+    {
+        result.Reset();
+        for (size_t i = 0; i < BucketCount; i++)
+        {
+            result.Buckets[i] = (uint32_t)Buckets[i];
+            result.Count += result.Buckets[i];
+            if (result.Buckets[i] != 0 && result.Min == UINT64_MAX)
+                result.Min = GetBucketLowest(i);
+        }
+        result.Sum = (uint64_t)AtomicCompareExchange((volatile int64_t *)&Sum, 0, 0);
+        result.Max = (uint64_t)AtomicCompareExchange((volatile int64_t *)&Max, 0, 0);
+    }
+};
+
+} // namespace Stats
@@ -1,11 +1,21 @@
 #include "Hook.h"
+#include "Asm.h"
+#include "StaticHook.h"
 #include "Common.h"
 #include "Patcher.h"
 #include "hde/hde32.h"
 #include <cassert>
+#include <map>
+#include <new>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
 
 using namespace SimpleHooker86;
 using namespace Patcher;
+using namespace Asm;
 
 static size_t GetInstrLen(const void *addr)
 {
@@ -14,6 +24,45 @@ static size_t GetInstrLen(const void *addr)
     return (hs.flags & HDE_F_ERROR) ? 0 : size;
 }
 
+// Imported functions are called through the IAT with 6 byte call [addr]
+const size_t IndirectCallSize = 6;
+
+// Returns the size of a call which a call hook may replace, 0 for other instructions
+static size_t GetCallSize(const void *callInstr)
+{
+    auto code = (const uint8_t *)callInstr;
+    size_t size = GetInstrLen(callInstr);
+    if (size == CallJmpSize || (size == IndirectCallSize && code[0] == 0xFF && code[1] == 0x15))
+        return size;
+    return 0;
+}
+
+// Sizes of calls before their first hooks. A hooked call is always 5 bytes long, so a hook of
+// a 6 byte call rebuilt on reload must take the size from here to overwrite the whole call
+class CCallSizes
+{
+public:
+    CCallSizes() { InitializeCriticalSection(&_lock); }
+    ~CCallSizes() { DeleteCriticalSection(&_lock); }
+
+    size_t Get(const void *callInstr)
+    {
+        EnterCriticalSection(&_lock);
+        auto it = _sizes.find(callInstr);
+        size_t size = it != _sizes.end() ? it->second : GetCallSize(callInstr);
+        if (it == _sizes.end() && size != 0)
+            _sizes.insert(std::make_pair(callInstr, size));
+        LeaveCriticalSection(&_lock);
+        return size;
+    }
+
+private:
+    CRITICAL_SECTION _lock;
+    std::map<const void *, size_t> _sizes;
+};
+
+static CCallSizes callSizes;
+
 static size_t CalcPatchSize(const void *codeAddr)
 {
     size_t size = 0;
@@ -27,6 +76,9 @@ static size_t CalcPatchSize(const void *codeAddr)
     return size;
 }
 
+const size_t PageSize = 4096;
+const size_t UnlockWindowSize = 16384; // Much more than any single helper
+
 class CHelpersGenerator
 {
 public:
@@ -35,7 +87,12 @@ public:
         , _memory(nullptr)
         , _currentAddr(nullptr)
         , _unlockAddr(nullptr)
+        , _windowAddr(nullptr)
+        , _windowSize(0)
+        , _unlockTime(0)
+        , _arenaTime(0)
     {
+        InitializeCriticalSection(&_lock);
         InitMemory();
     }
 
@@ -43,6 +100,7 @@ public:
     {
         assert(_unlockAddr == nullptr);
         FreeMemory();
+        DeleteCriticalSection(&_lock);
     }
 
     void *CreateFunctionWrapper(const void *func, size_t argsSize, ECallingConvention callConv);
@@ -54,11 +112,28 @@ public:
 
     void *CreateTrampoline(const void *codeAddr);
 
+    void *CreateJump(const void *to);
+
+    void *CreateTimingEntry(const void *func, Stats::SAtomicHistogram *histogram,
+                            uint16_t traceId);
+
+    void *CreateTimingExit();
+
+    // Copies the code to the current position
+    void *Emit(const CAssemblerBase &code)
+    {
+        char *result = _currentAddr;
+        if (!code.IsValid() || result + code.GetSize() > _windowAddr + _windowSize)
+            return nullptr;
+        _currentAddr += code.Write(result);
+        return result;
+    }
+
     void Align()
     {
         auto &addr = _currentAddr;
         size_t alignment = sizeof(void *);
-        if (addr > _memory)
+        if (addr > _memory && addr + alignment <= _windowAddr + _windowSize)
             addr += WriteNops(addr, alignment - (uintptr_t)addr % alignment);
     }
 
@@ -71,31 +146,60 @@ public:
         }
 
         DWORD oldProtect;
-        BOOL res = VirtualProtect(_memory, _memorySize, PAGE_EXECUTE_READ, &oldProtect);
+        BOOL res = VirtualProtect(_windowAddr, _windowSize, PAGE_EXECUTE_READ, &oldProtect);
         VERIFY(res);
         // Confirm made changes
-        FlushInstructionCache(GetCurrentProcess(), _memory, _memorySize);
+        FlushInstructionCache(GetCurrentProcess(), _windowAddr, _windowSize);
         _unlockAddr = nullptr;
+
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        _arenaTime += now.QuadPart - _unlockTime;
+        LeaveCriticalSection(&_lock);
     }
 
+    // Only a window after the current position is unlocked, so the cost
+    // doesn't grow with the number of installed hooks. Hooks may be created
+    // from several threads, the memory is owned by one of them until MemLock
     void MemUnlock()
     {
+        EnterCriticalSection(&_lock);
+        LARGE_INTEGER now;
+        QueryPerformanceCounter(&now);
+        _unlockTime = now.QuadPart;
+
+        _windowAddr = _memory + (_currentAddr - _memory) / PageSize * PageSize;
+        _windowSize = std::min(UnlockWindowSize, (size_t)(_memory + _memorySize - _windowAddr));
+        // The window starts at the page of live helpers, which other threads may be running
         DWORD oldProtect;
-        BOOL res = VirtualProtect(_memory, _memorySize, PAGE_READWRITE, &oldProtect);
+        BOOL res = VirtualProtect(_windowAddr, _windowSize, PAGE_EXECUTE_READWRITE, &oldProtect);
         VERIFY(res);
         _unlockAddr = _currentAddr;
     }
 
+    void GetStats(SimpleHooker86::SHookStats &stats)
+    {
+        EnterCriticalSection(&_lock);
+        stats.ArenaTime = _arenaTime;
+        stats.ArenaBytes = (size_t)(_currentAddr - _memory);
+        LeaveCriticalSection(&_lock);
+    }
+
 private:
     size_t _memorySize;
     char *_memory;
     char *_currentAddr;
     char *_unlockAddr;
+    char *_windowAddr;
+    size_t _windowSize;
+    CRITICAL_SECTION _lock;
+    int64_t _unlockTime;
+    int64_t _arenaTime; // Between MemUnlock and MemLock, in QueryPerformanceCounter units
 
     void InitMemory()
     {
-        // Should be enough for at least 128 trampolines
-        _memorySize = 16384;
+        // Should be enough for several thousands of hooks
+        _memorySize = 1024 * 1024;
         // Reserve one extra page to catch out of range write
         _memory = (char *)VirtualAlloc(NULL, _memorySize + 4096, MEM_RESERVE, PAGE_EXECUTE_READ);
         VERIFY(_memory != nullptr);
@@ -108,6 +212,7 @@ private:
     void FreeMemory() { VirtualFree(_memory, 0, MEM_RELEASE); }
 };
 static CHelpersGenerator helpersGen;
+static volatile LONG hookCount = 0;
 
 void *CHelpersGenerator::CreateFunctionWrapper(const void *func, size_t argsSize,
                                                ECallingConvention callConv)
@@ -119,113 +224,202 @@ void *CHelpersGenerator::CreateFunctionWrapper(const void *func, size_t argsSize
                    callConv == SimpleHooker86::CC_THISCALL_VAR;
     bool isFastCall = callConv == SimpleHooker86::CC_FASTCALL;
     bool isThisCall = callConv == SimpleHooker86::CC_THISCALL;
-    char *result = _currentAddr;
-    auto &addr = _currentAddr;
+    CAssembler<256> a;
 
-    // clang-format off
-    addr += WriteBytes(addr,
-        0x55,                                          // push   ebp
-        0x89, 0xE5,                                    // mov    ebp, esp
-        0x51,                                          // push   ecx
-        0x52);                                         // push   edx
+    a.Push(RN_EBP).Mov(RN_EBP, RN_ESP).Push(RN_ECX).Push(RN_EDX);
 
     // Copy original function arguments
-    for (int i = argsSize + 4; i > 4; i -= 4)
-        addr += WriteBytes(addr, 0xFF, 0x75, i);       // push   dword [ebp + i]
-                                                       // ; fastcall:
-    addr += isFastCall ? WriteBytes(addr, 0x52) : 0;   // push   edx ; arg1 (fastcall)
-    addr += (isFastCall || isThisCall)                 // ; fastcall or thiscall:
-        ? WriteBytes(addr, 0x51) : 0;                  // push   ecx ; arg0 or this
+    for (size_t i = argsSize + 4; i > 4; i -= 4)
+        a.Push(Mem(RN_EBP, (int32_t)i));
+    if (isFastCall)
+        a.Push(RN_EDX); // arg1
+    if (isFastCall || isThisCall)
+        a.Push(RN_ECX); // arg0 or this
 
-    addr += WriteCall(addr, func);                     // call   callback
+    a.Call(func);
 
     // Epilog
-    addr += WriteBytes(addr,
-        0x8D, 0x65, 0xF8,                              // lea    esp, [ebp - 8]
-        0x5A,                                          // pop    edx
-        0x59,                                          // pop    ecx
-        0xC9);                                         // leave
-    addr += isCdecl ? WriteBytes(addr, 0xC3) :         // retn            ; cdecl
-        WriteBytes(addr, 0xC2, argsSize, 0x00);        // retn   argsSize ; other
-    // clang-format on
+    a.Lea(RN_ESP, Mem(RN_EBP, -8)).Pop(RN_EDX).Pop(RN_ECX).Leave();
+    if (isCdecl)
+        a.Ret();
+    else
+        a.Ret((uint16_t)argsSize);
 
-    return result;
+    return Emit(a);
 }
 
 void *CHelpersGenerator::CreateCallbackWrapper(const void *codeAddr, EOrigCodePosition codePos,
                                                const void *callback, void *cbArg)
 {
-    char *result = _currentAddr;
-    auto &addr = _currentAddr;
-    bool before = codePos == OCP_BEFORE;
-    bool after = codePos == OCP_AFTER;
     size_t codeSize = CalcPatchSize(codeAddr);
     if (codeSize == 0)
         return NULL;
     auto defaultRetAddr = (uint32_t)((char *)codeAddr + codeSize);
-
-    addr += before ? WritePatch(addr, codeAddr, codeSize) : 0; // ... Original bytes ...
-    addr += WriteByte(addr, 0x60);                             // pushad
-    addr += WriteByte(addr, 0x9C);                             // pushfd
-    addr += WritePush(addr, defaultRetAddr);                   // push   retaddr
-    addr += WriteBytes(addr, 0x89, 0xE5);                      // mov    ebp, esp
-    addr += WritePush(addr, RN_EBP);                           // push   ebp
-    addr += WritePush(addr, (uint32_t)cbArg);                  // push   cbArg
-    addr += WriteCall(addr, callback);                         // call   callback
-    addr += WriteBytes(addr, 0x89, 0xEC);                      // mov    esp, ebp
-    addr += WritePop(addr, RN_EAX);                            // pop    eax
-    addr += WriteByte(addr, 0x9D);                             // popfd
-    addr += WriteByte(addr, 0x61);                             // popad
-    addr += after ? WritePatch(addr, codeAddr, codeSize) : 0;  // ... Original bytes ...
-    addr += WriteBytes(addr, 0xFF, 0x64, 0x24, 0xD8);          // jmp    dword [esp - 0x28]
-
-    return result;
+    CAssembler<128> a;
+
+    if (codePos == OCP_BEFORE)
+        a.Bytes(codeAddr, codeSize); // ... Original bytes ...
+    a.Pushad().Pushfd();
+    a.Push(defaultRetAddr);
+    a.Mov(RN_EBP, RN_ESP);
+    a.Push(RN_EBP).Push((uint32_t)cbArg).Call(callback);
+    a.Mov(RN_ESP, RN_EBP);
+    a.Pop(RN_EAX).Popfd().Popad();
+    if (codePos == OCP_AFTER)
+        a.Bytes(codeAddr, codeSize); // ... Original bytes ...
+    a.Jmp(Mem(RN_ESP, -0x28));       // The return address left by pushes above
+
+    return Emit(a);
 }
 
 void *CHelpersGenerator::CreateConverter(ECallingConvention conv)
 {
-    char *result = _currentAddr;
-    auto &addr = _currentAddr;
-    static const uint8_t std2this[] = {
-        0x59,             // pop   ecx
-        0x87, 0x0C, 0x24, // xchg  [esp], ecx
-    };
-    static const uint8_t std2fast[] = {
-        0x5A,                   // pop   edx
-        0x87, 0x54, 0x24, 0x04, // xchg  edx, [esp + 4]
-        0x59,                   // pop   ecx
-    };
+    CAssembler<16> a;
 
     switch (conv)
     {
     case SimpleHooker86::CC_STDCALL:
-        /* Do nothing */
-        break;
     case SimpleHooker86::CC_CDECL:
-        return nullptr; // Not implemented yet
+    case SimpleHooker86::CC_THISCALL_VAR:
+        /* Do nothing, original function is called with its own convention */
+        break;
     case SimpleHooker86::CC_FASTCALL:
-        addr += WritePatch(addr, std2fast);
+        a.Pop(RN_EDX).Xchg(Mem(RN_ESP, 4), RN_EDX).Pop(RN_ECX);
         break;
     case SimpleHooker86::CC_THISCALL:
-        addr += WritePatch(addr, std2this);
+        a.Pop(RN_ECX).Xchg(Mem(RN_ESP), RN_ECX);
         break;
-    case SimpleHooker86::CC_THISCALL_VAR:
-        return nullptr; // Not implemented yet
     }
 
-    return result;
+    return Emit(a);
 }
 
 void *CHelpersGenerator::CreateTrampoline(const void *codeAddr)
 {
     size_t size = CalcPatchSize(codeAddr);
-    char *result = _currentAddr;
-    auto &addr = _currentAddr;
-    addr += WritePatch(addr, codeAddr, size);
-    addr += WriteJump(addr, (char *)codeAddr + size);
+    CAssembler<32> a;
+    a.Bytes(codeAddr, size).Jmp((char *)codeAddr + size);
+    return Emit(a);
+}
+
+void *CHelpersGenerator::CreateJump(const void *to)
+{
+    CAssembler<8> a;
+    a.Jmp(to);
+    return Emit(a);
+}
+
+struct STimingFrame
+{
+    void **RetSlot;
+    void *RetAddr;
+    Stats::SAtomicHistogram *Histogram;
+    uint64_t StartTicks;
+    uint16_t TraceId;
+};
+
+struct STimingStack
+{
+    size_t Depth;
+    STimingFrame Frames[TimingStackDepth];
+};
+
+static DWORD timingTlsIndex = TLS_OUT_OF_INDEXES;
+static void *timingExitThunk = nullptr;
+static HookEnterPtr volatile timingEnterTracer = nullptr;
+static HookExitPtr volatile timingExitTracer = nullptr;
+
+static STimingStack *GetTimingStack()
+{
+    // TlsGetValue always resets the last error, but the hooked function may have set it
+    DWORD lastError = GetLastError();
+    auto stack = (STimingStack *)TlsGetValue(timingTlsIndex);
+    if (stack == nullptr)
+    {
+        stack = (STimingStack *)VirtualAlloc(NULL, sizeof(STimingStack), MEM_RESERVE | MEM_COMMIT,
+                                             PAGE_READWRITE);
+        if (stack != nullptr)
+            TlsSetValue(timingTlsIndex, stack);
+    }
+    SetLastError(lastError);
+    return stack;
+}
+
+static void __stdcall TimingEnter(Stats::SAtomicHistogram *histogram, uint32_t traceId,
+                                  void **retSlot)
+{
+    STimingStack *stack = GetTimingStack();
+    if (stack == nullptr)
+        return;
+
+    // Frames at or below the new return slot were left by calls unwound by an exception
+    while (stack->Depth > 0 && stack->Frames[stack->Depth - 1].RetSlot <= retSlot)
+        stack->Depth--;
+    if (stack->Depth == TimingStackDepth)
+        return; // Too deep, just don't measure this call
+
+    // The tracer isn't measured, it's called before the start and after the end
+    HookEnterPtr tracer = timingEnterTracer;
+    if (tracer != nullptr)
+        tracer((uint16_t)traceId, (uint32_t)(uintptr_t)retSlot[1], (uint32_t)(uintptr_t)retSlot[2]);
+
+    STimingFrame &frame = stack->Frames[stack->Depth++];
+    frame.RetSlot = retSlot;
+    frame.RetAddr = *retSlot;
+    frame.Histogram = histogram;
+    frame.TraceId = (uint16_t)traceId;
+    frame.StartTicks = __rdtsc();
+    *retSlot = timingExitThunk;
+}
+
+static void *__stdcall TimingExit(void **stackPtr)
+{
+    uint64_t ticks = __rdtsc();
+    STimingStack *stack = GetTimingStack();
+    VERIFY(stack != nullptr);
+
+    // The returning frame is the outermost one below the stack pointer (it is
+    // above the return slot by the size of arguments popped by the function),
+    // deeper ones are stale
+    while (stack->Depth > 1 && stack->Frames[stack->Depth - 2].RetSlot < stackPtr)
+        stack->Depth--;
+    VERIFY(stack->Depth > 0 && stack->Frames[stack->Depth - 1].RetSlot < stackPtr);
+
+    STimingFrame &frame = stack->Frames[--stack->Depth];
+    frame.Histogram->Record(ticks - frame.StartTicks);
+    HookExitPtr tracer = timingExitTracer;
+    if (tracer != nullptr)
+        tracer(frame.TraceId, (uint32_t)(uintptr_t)stackPtr[-2]); // eax saved by the exit thunk
+    return frame.RetAddr;
+}
+
+void *CHelpersGenerator::CreateTimingEntry(const void *func, Stats::SAtomicHistogram *histogram,
+                                           uint16_t traceId)
+{
+    CAssembler<32> a;
+    a.Push(RN_EAX).Push(RN_ECX).Push(RN_EDX);
+    a.Lea(RN_EAX, Mem(RN_ESP, 12)).Push(RN_EAX); // Return slot
+    a.Push((uint32_t)traceId).Push((uint32_t)histogram).Call((void *)TimingEnter);
+    a.Pop(RN_EDX).Pop(RN_ECX).Pop(RN_EAX);
+
+    void *result = Emit(a);
+    if (result == nullptr || CreateTrampoline(func) == nullptr) // ... Original bytes ...
+        return nullptr;
     return result;
 }
 
+void *CHelpersGenerator::CreateTimingExit()
+{
+    CAssembler<32> a;
+    a.Push(RN_EAX); // Room for the return address
+    a.Push(RN_EAX).Push(RN_ECX).Push(RN_EDX);
+    a.Lea(RN_EAX, Mem(RN_ESP, 16)).Push(RN_EAX); // Old esp
+    a.Call((void *)TimingExit);
+    a.Mov(Mem(RN_ESP, 12), RN_EAX);
+    a.Pop(RN_EDX).Pop(RN_ECX).Pop(RN_EAX).Ret();
+    return Emit(a);
+}
+
 bool SimpleHooker86::CreateFuncHook(void *sourceFunc, size_t argsSize, ECallingConvention callConv,
                                     const void *targetFunc, void **origFunc, Patcher::SPatch &patch)
 {
@@ -255,6 +449,7 @@ bool SimpleHooker86::CreateFuncHook(void *sourceFunc, size_t argsSize, ECallingC
     patch.WriteNops(patchSize - CallJmpSize);
     if (origFunc)
         *origFunc = tramp;
+    InterlockedIncrement(&hookCount);
     return true;
 
 fail:
@@ -266,7 +461,8 @@ bool SimpleHooker86::CreateFuncCallHook(void *callInstr, size_t argsSize,
                                         ECallingConvention callConv, const void *targetFunc,
                                         Patcher::SPatch &patch)
 {
-    if (GetInstrLen(callInstr) != CallJmpSize)
+    size_t callSize = callSizes.Get(callInstr);
+    if (callSize == 0)
         return false;
 
     helpersGen.MemUnlock();
@@ -276,7 +472,11 @@ bool SimpleHooker86::CreateFuncCallHook(void *callInstr, size_t argsSize,
     helpersGen.MemLock(!result);
 
     if (result)
+    {
         patch.WriteCall(callInstr, wrap);
+        patch.WriteNops(callSize - CallJmpSize);
+        InterlockedIncrement(&hookCount);
+    }
     return result;
 }
 
@@ -290,7 +490,8 @@ bool SimpleHooker86::CreateCodeHook(void *codeAddr, EOrigCodePosition codePos,
 
     helpersGen.MemUnlock();
     helpersGen.Align();
-    void *wrapper = helpersGen.CreateCallbackWrapper(codeAddr, codePos, callback, callbackArg);
+    void *wrapper = helpersGen.CreateCallbackWrapper(codeAddr, codePos, (const void *)callback,
+                                                     callbackArg);
     if (!wrapper)
         goto fail;
     helpersGen.MemLock();
@@ -298,9 +499,157 @@ bool SimpleHooker86::CreateCodeHook(void *codeAddr, EOrigCodePosition codePos,
     patch.SetAddr(codeAddr);
     patch.WriteJump(wrapper);
     patch.WriteNops(patchSize - CallJmpSize);
+    InterlockedIncrement(&hookCount);
     return true;
 
 fail:
     helpersGen.MemLock(true);
     return false;
 }
+
+bool SimpleHooker86::CreateTimingHook(void *func, Stats::SAtomicHistogram *histogram,
+                                      uint16_t traceId, Patcher::SPatch &patch)
+{
+    size_t patchSize = CalcPatchSize(func);
+    if (patchSize == 0 || histogram == nullptr)
+        return false;
+
+    // Shared state is initialized under the helpers memory lock
+    helpersGen.MemUnlock();
+    if (timingTlsIndex == TLS_OUT_OF_INDEXES)
+    {
+        timingTlsIndex = TlsAlloc();
+        if (timingTlsIndex == TLS_OUT_OF_INDEXES)
+        {
+            helpersGen.MemLock();
+            return false;
+        }
+    }
+
+    bool exitCreated = timingExitThunk == nullptr;
+    if (exitCreated)
+    {
+        helpersGen.Align();
+        timingExitThunk = helpersGen.CreateTimingExit();
+    }
+    helpersGen.Align();
+    void *entry = nullptr;
+    if (timingExitThunk != nullptr)
+        entry = helpersGen.CreateTimingEntry(func, histogram, traceId);
+    if (entry == nullptr)
+    {
+        // The reverted memory may hold the new exit thunk
+        if (exitCreated)
+            timingExitThunk = nullptr;
+        helpersGen.MemLock(true);
+        return false;
+    }
+    helpersGen.MemLock();
+
+    patch.SetAddr(func);
+    patch.WriteJump(entry);
+    patch.WriteNops(patchSize - CallJmpSize);
+    InterlockedIncrement(&hookCount);
+    return true;
+}
+
+bool SimpleHooker86::CreateStaticFuncHook(void *sourceFunc, const void *thunk, void **origFunc,
+                                          Patcher::SPatch &patch)
+{
+    size_t patchSize = CalcPatchSize(sourceFunc);
+    if (patchSize == 0)
+        return false;
+
+    // Don't touch the helpers memory if the original function isn't needed
+    if (origFunc)
+    {
+        helpersGen.MemUnlock();
+        helpersGen.Align();
+        void *tramp = helpersGen.CreateTrampoline(sourceFunc);
+        helpersGen.MemLock(tramp == nullptr);
+        if (tramp == nullptr)
+            return false;
+        *origFunc = tramp;
+    }
+
+    patch.SetAddr(sourceFunc);
+    patch.WriteJump(thunk);
+    patch.WriteNops(patchSize - CallJmpSize);
+    InterlockedIncrement(&hookCount);
+    return true;
+}
+
+bool SimpleHooker86::CreateStaticFuncCallHook(void *callInstr, const void *thunk,
+                                              Patcher::SPatch &patch)
+{
+    size_t callSize = callSizes.Get(callInstr);
+    if (callSize == 0)
+        return false;
+
+    patch.WriteCall(callInstr, thunk);
+    patch.WriteNops(callSize - CallJmpSize);
+    InterlockedIncrement(&hookCount);
+    return true;
+}
+
+// Functions which were in vtable slots before their first hooks, under the helpers memory lock
+static std::map<void **, void *> vtableOrigFuncs;
+
+bool SimpleHooker86::CreateVtableHook(void **vtable, size_t index, size_t argsSize,
+                                      ECallingConvention callConv, const void *targetFunc,
+                                      void **origFunc, Patcher::SPatch &patch)
+{
+    void **slot = vtable + index;
+    void *wrap, *tramp;
+    helpersGen.MemUnlock();
+    auto orig = vtableOrigFuncs.insert(std::make_pair(slot, *slot)).first;
+    helpersGen.Align();
+
+    // The converter is followed by a jump to the original function
+    tramp = helpersGen.CreateConverter(callConv);
+    if (!tramp || helpersGen.CreateJump(orig->second) == nullptr)
+        goto fail;
+
+    helpersGen.Align();
+    wrap = helpersGen.CreateFunctionWrapper(targetFunc, argsSize, callConv);
+    if (wrap == nullptr)
+        goto fail;
+    helpersGen.MemLock();
+
+    patch.WritePtr(slot, wrap);
+    if (origFunc)
+        *origFunc = tramp;
+    InterlockedIncrement(&hookCount);
+    return true;
+
+fail:
+    helpersGen.MemLock(true);
+    return false;
+}
+
+void **SimpleHooker86::CreateShadowVtable(const void *object, size_t slotCount)
+{
+    void **vtable = *(void **const *)object;
+    auto shadow = new (std::nothrow) void *[slotCount + 1];
+    if (shadow == nullptr)
+        return nullptr;
+    memcpy(shadow, vtable - 1, (slotCount + 1) * sizeof(void *));
+    return shadow + 1;
+}
+
+void **SimpleHooker86::SwapVtable(void *object, void **vtable)
+{
+    return (void **)InterlockedExchange((volatile LONG *)object, (LONG)vtable);
+}
+
+void SimpleHooker86::SetTimingHookTracer(HookEnterPtr enter, HookExitPtr exit)
+{
+    timingEnterTracer = enter;
+    timingExitTracer = exit;
+}
+
+void SimpleHooker86::GetHookStats(SHookStats &stats)
+{
+    helpersGen.GetStats(stats);
+    stats.HookCount = (uint32_t)hookCount;
+}
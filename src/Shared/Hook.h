@@ -1,5 +1,6 @@
 #pragma once
 
+#include "Shared/Histogram.h"
 #include "Shared/Patcher.h"
 #include <stdint.h>
 
@@ -27,6 +28,10 @@ enum ECallingConvention
  * This function creates a trampoline which transfers control
  * to the specified target function with corresponding calling convention
  * of the source function and returns a pointer to the trampoline.
+ *
+ * The original function is called through origFunc as stdcall for
+ * stdcall, fastcall and thiscall functions, and as cdecl for cdecl
+ * and thiscall with variable arguments.
  */
 bool CreateFuncHook(void *sourceFunc, size_t argsSize, ECallingConvention callConv,
                     const void *targetFunc, void **origFunc, Patcher::SPatch &patch);
@@ -37,10 +42,38 @@ bool CreateFuncHook(void *sourceFunc, size_t argsSize, ECallingConvention callCo
  * This function creates a trampoline which transfers control
  * to the specified target function with corresponding calling convention
  * of the source function and returns a pointer to the trampoline.
+ *
+ * The call may be direct or through a pointer at an absolute address, as
+ * imported functions are called.
  */
 bool CreateFuncCallHook(void *callInstr, size_t argsSize, ECallingConvention callConv,
                         const void *targetFunc, Patcher::SPatch &patch);
 
+/*
+ * Creates a hook of a virtual function by replacing its slot in the vtable.
+ *
+ * All objects using the vtable call the target through a wrapper created the
+ * same way as for CreateFuncHook, so the target and origFunc have the same
+ * conventions. No code is patched, the slot is written by the patch, so it
+ * can be restored by reapplying it. If the slot was hooked before, origFunc
+ * is the function which was in it before the first hook.
+ */
+bool CreateVtableHook(void **vtable, size_t index, size_t argsSize, ECallingConvention callConv,
+                      const void *targetFunc, void **origFunc, Patcher::SPatch &patch);
+
+/*
+ * Copies the vtable of the object to hook virtual functions of this object only.
+ *
+ * slotCount must not exceed the number of virtual functions of the class. The
+ * RTTI pointer before the slots is copied too. Slots of the copy are hooked by
+ * CreateVtableHook and ApplyPatch, then it's given to the object by SwapVtable.
+ * The copy is never freed, as other threads may still call through it.
+ */
+void **CreateShadowVtable(const void *object, size_t slotCount);
+
+// Atomically replaces the vtable of the object, returns the previous one
+void **SwapVtable(void *object, void **vtable);
+
 #if defined(_MSC_VER) && defined(_MSC_EXTENSIONS)
 #pragma warning(push)
 #pragma warning(disable : 4201) // nonstandard extension used : nameless struct/union
@@ -97,4 +130,45 @@ typedef void(__stdcall *CodeHookCallbackPtr)(void *callbackArg, SCodeHookCtx *co
 bool CreateCodeHook(void *codeAddr, EOrigCodePosition codePos, CodeHookCallbackPtr callback,
                     void *callbackArg, Patcher::SPatch &patch);
 
+/*
+ * Creates a hook which measures execution time of the specified function.
+ *
+ * On entry the hook saves a TSC timestamp and replaces the return address
+ * of the call, so the function returns through a common exit thunk which
+ * records the elapsed ticks into the histogram. No user callback is needed
+ * and the calling convention of the function doesn't matter.
+ *
+ * Calls nested deeper than TimingStackDepth in one thread are not measured.
+ */
+const size_t TimingStackDepth = 256;
+
+bool CreateTimingHook(void *func, Stats::SAtomicHistogram *histogram, uint16_t traceId,
+                      Patcher::SPatch &patch);
+
+/*
+ * Functions called by timing hooks on entry and exit of measured calls, e.g.
+ * Trace::Enter and Trace::Exit. They get traceId of the hook, the first two
+ * stack arguments of the call and the returned eax. Nothing is called until
+ * they are set.
+ */
+typedef void (*HookEnterPtr)(uint16_t traceId, uint32_t a0, uint32_t a1);
+typedef void (*HookExitPtr)(uint16_t traceId, uint32_t result);
+
+void SetTimingHookTracer(HookEnterPtr enter, HookExitPtr exit);
+
+/*
+ * Counters of all hooks created so far, including static ones.
+ *
+ * ArenaTime is the time spent generating helpers code, with changes of the
+ * helpers memory protection, in QueryPerformanceCounter units.
+ */
+struct SHookStats
+{
+    uint32_t HookCount;
+    int64_t ArenaTime;
+    size_t ArenaBytes;
+};
+
+void GetHookStats(SHookStats &stats);
+
 } // namespace SimpleHooker86
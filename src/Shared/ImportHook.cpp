@@ -0,0 +1,55 @@
+#include "ImportHook.h"
+#include "PeImage.h"
+#include <vector>
+#include <windows.h>
+
+using namespace SimpleHooker86;
+
+// Without lookup tables the loaded IAT has no names, so the slots are found by the address
+// which the loader wrote there
+static void FindBoundSlots(const uint8_t *base, const std::vector<PeImage::SImport> &imports,
+                           const SImportHook &hook, std::vector<uint32_t> &slots)
+{
+    HMODULE module = GetModuleHandleA(hook.Module);
+    const void *func = module != NULL ? (const void *)GetProcAddress(module, hook.Function) : NULL;
+    if (func == NULL)
+        return;
+
+    for (auto it = imports.cbegin(); it != imports.cend(); ++it)
+    {
+        const void *addr = Patcher::ReadPtr(base + it->IatRva);
+        if (it->Name.empty() && it->Ordinal == 0 && (addr == func || addr == hook.Target))
+            slots.push_back(it->IatRva);
+    }
+}
+
+bool SimpleHooker86::CreateImportHooks(void *module, const SImportHook *hooks, size_t count,
+                                       Patcher::SPatch &patch)
+{
+    PeImage::CPeImage image;
+    std::vector<PeImage::SImport> imports;
+    if (!image.ParseModule(module) || !image.ReadImports(imports))
+        return false;
+
+    auto base = (uint8_t *)module;
+    std::vector<uint32_t> slots;
+    for (size_t i = 0; i < count; i++)
+    {
+        const SImportHook &hook = hooks[i];
+        slots.clear();
+        PeImage::FindImportSlots(imports, hook.Module, hook.Function, slots);
+        if (slots.empty())
+            FindBoundSlots(base, imports, hook, slots);
+        if (slots.empty())
+            return false;
+
+        for (auto it = slots.cbegin(); it != slots.cend(); ++it)
+        {
+            void *orig = Patcher::ReadPtr(base + *it);
+            if (hook.OrigFunc != nullptr && orig != hook.Target)
+                *hook.OrigFunc = orig;
+            patch.WritePtr(base + *it, hook.Target);
+        }
+    }
+    return true;
+}
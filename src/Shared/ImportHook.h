@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Shared/Patcher.h"
+#include <cstddef>
+
+//
+// Hooks of functions imported by a module.
+//
+// An import hook replaces the address in the IAT slot of the function, so the
+// module calls the target directly: there is no code added per call, and the
+// function itself stays untouched for other modules. Only calls through the
+// IAT of the module are hooked, addresses from GetProcAddress are not.
+//
+// The slots are written by the patch, so all hooks of a patch are installed
+// at once and only the IAT pages are made writable. Nothing is generated at
+// runtime, so a reloadable patch removes its hooks when it's disabled.
+//
+
+namespace SimpleHooker86 {
+
+struct SImportHook
+{
+    const char *Module;   // Case insensitive, e.g. "kernel32.dll"
+    const char *Function; // Functions imported by ordinal can't be hooked
+    const void *Target;   // With the same calling convention and arguments
+    void **OrigFunc;      // May be nullptr
+};
+
+/*
+ * Writes the targets to the IAT slots of the functions imported by the loaded module.
+ *
+ * origFunc gets the address in the slot when the patch is built, it's kept if
+ * the slot already holds the target, e.g. when the patch is rebuilt on reload.
+ * Returns false if the imports can't be read or a function isn't imported.
+ */
+bool CreateImportHooks(void *module, const SImportHook *hooks, size_t count,
+                       Patcher::SPatch &patch);
+
+template <size_t Count>
+bool CreateImportHooks(void *module, const SImportHook (&hooks)[Count], Patcher::SPatch &patch)
+{
+    return CreateImportHooks(module, hooks, Count, patch);
+}
+
+} // namespace SimpleHooker86
@@ -0,0 +1,311 @@
+#include "Ini.h"
+#include <cstdio>
+#include <cstring>
+
+using namespace Ini;
+
+namespace {
+
+const size_t MinTableSize = 64;
+
+inline bool IsSpace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+SStringRef Trim(const char *begin, const char *end)
+{
+    while (begin < end && IsSpace(*begin))
+        begin++;
+    while (end > begin && IsSpace(end[-1]))
+        end--;
+    SStringRef result = {begin, (size_t)(end - begin)};
+    return result;
+}
+
+SStringRef Unquote(SStringRef str)
+{
+    if (str.Size >= 2 && (str.Data[0] == '"' || str.Data[0] == '\'') &&
+        str.Data[str.Size - 1] == str.Data[0])
+    {
+        str.Data++;
+        str.Size -= 2;
+    }
+    return str;
+}
+
+SStringRef MakeRef(const char *str)
+{
+    SStringRef result = {str, strlen(str)};
+    return result;
+}
+
+bool EqualNames(const SStringRef &a, const SStringRef &b)
+{
+    if (a.Size != b.Size)
+        return false;
+    for (size_t i = 0; i < a.Size; i++)
+    {
+        if (ToLowerAscii(a.Data[i]) != ToLowerAscii(b.Data[i]))
+            return false;
+    }
+    return true;
+}
+
+uint32_t HashName(uint32_t hash, const SStringRef &str)
+{
+    for (size_t i = 0; i < str.Size; i++)
+        hash = HashByte(hash, (uint8_t)ToLowerAscii(str.Data[i]));
+    return hash;
+}
+
+// Must match Ini::HashKey. The separator makes "ab" + "c" and "a" + "bc" differ
+uint32_t GetHash(const SStringRef &section, const SStringRef &key)
+{
+    return HashName(HashByte(HashName(FnvOffset, section), 0xFF), key);
+}
+
+// Parses digits of an optionally signed decimal or 0x hexadecimal number. Returns the end of
+// parsed characters, it's the start if there are no digits
+const char *ParseNumber(const char *p, const char *end, bool *negative, uint32_t *result)
+{
+    const char *start = p;
+    *negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        *negative = *p++ == '-';
+
+    unsigned base = 10;
+    if (end - p > 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))
+    {
+        base = 16;
+        p += 2;
+    }
+
+    const char *digits = p;
+    *result = 0;
+    for (; p < end; p++)
+    {
+        char c = ToLowerAscii(*p);
+        unsigned digit;
+        if (c >= '0' && c <= '9')
+            digit = c - '0';
+        else if (base == 16 && c >= 'a' && c <= 'f')
+            digit = c - 'a' + 10;
+        else
+            break;
+        *result = *result * base + digit;
+    }
+    return p != digits ? p : start;
+}
+
+} // namespace
+
+bool Ini::EqualNoCase(const SStringRef &str, const char *name)
+{
+    return EqualNames(str, MakeRef(name));
+}
+
+bool Ini::ParseInt(const SStringRef &str, int *result)
+{
+    bool negative;
+    uint32_t value;
+    const char *end = str.Data + str.Size;
+    if (str.Size == 0 || ParseNumber(str.Data, end, &negative, &value) != end)
+        return false;
+    *result = negative ? -(int)value : (int)value;
+    return true;
+}
+
+bool Ini::ParseUInt(const SStringRef &str, uint32_t *result)
+{
+    bool negative;
+    const char *end = str.Data + str.Size;
+    return str.Size != 0 && ParseNumber(str.Data, end, &negative, result) == end && !negative;
+}
+
+int Ini::ParseIntPrefix(const SStringRef &str)
+{
+    bool negative;
+    uint32_t result;
+    if (ParseNumber(str.Data, str.Data + str.Size, &negative, &result) == str.Data)
+        return 0;
+    return negative ? -(int)result : (int)result;
+}
+
+bool Ini::ParseBool(const SStringRef &str, bool *result)
+{
+    static const char *const trueNames[] = {"1", "true", "yes", "on"};
+    static const char *const falseNames[] = {"0", "false", "no", "off"};
+    for (size_t i = 0; i < sizeof(trueNames) / sizeof(trueNames[0]); i++)
+    {
+        if (EqualNames(str, MakeRef(trueNames[i])))
+        {
+            *result = true;
+            return true;
+        }
+        if (EqualNames(str, MakeRef(falseNames[i])))
+        {
+            *result = false;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool CIniFile::Load(const char *filename)
+{
+    _data.clear();
+    _entries.clear();
+    _table.clear();
+
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr)
+        return false;
+
+    bool result = false;
+    long size;
+    if (fseek(file, 0, SEEK_END) != 0)
+        goto fail;
+    size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0)
+        goto fail;
+    _data.resize((size_t)size);
+    if (size != 0 && fread(&_data[0], 1, _data.size(), file) != _data.size())
+    {
+        _data.clear();
+        goto fail;
+    }
+
+    ParseData();
+    result = true;
+
+fail:
+    fclose(file);
+    return result;
+}
+
+void CIniFile::Parse(const char *data, size_t size)
+{
+    _data.assign(data, data + size);
+    _entries.clear();
+    _table.clear();
+    ParseData();
+}
+
+void CIniFile::ParseData()
+{
+    if (_data.empty())
+        return;
+
+    // Names of sections which were already seen, a repeated section is skipped
+    std::vector<SStringRef> sections;
+    bool inSection = false;
+    SStringRef section = {nullptr, 0};
+
+    const char *p = &_data[0];
+    const char *end = p + _data.size();
+    while (p < end)
+    {
+        auto lineEnd = (const char *)memchr(p, '\n', (size_t)(end - p));
+        if (lineEnd == nullptr)
+            lineEnd = end;
+        SStringRef line = Trim(p, lineEnd);
+        p = lineEnd < end ? lineEnd + 1 : end;
+
+        if (line.Size == 0 || line.Data[0] == ';')
+            continue;
+
+        const char *lineLast = line.Data + line.Size;
+        if (line.Data[0] == '[')
+        {
+            auto close = (const char *)memchr(line.Data, ']', line.Size);
+            section = Trim(line.Data + 1, close != nullptr ? close : lineLast);
+            inSection = true;
+            for (size_t i = 0; i < sections.size() && inSection; i++)
+                inSection = !EqualNames(sections[i], section);
+            if (inSection)
+                sections.push_back(section);
+            continue;
+        }
+
+        // Keys before the first section and lines without '=' can't be read
+        auto eq = (const char *)memchr(line.Data, '=', line.Size);
+        if (!inSection || eq == nullptr)
+            continue;
+
+        SEntry entry;
+        entry.Section = section;
+        entry.Key = Trim(line.Data, eq);
+        entry.Value = Unquote(Trim(eq + 1, lineLast));
+        entry.Hash = GetHash(entry.Section, entry.Key);
+        AddEntry(entry);
+    }
+}
+
+void CIniFile::AddEntry(const SEntry &entry)
+{
+    // The load factor is kept below 1/2
+    if ((_entries.size() + 1) * 2 > _table.size())
+    {
+        size_t newSize = _table.empty() ? MinTableSize : _table.size() * 2;
+        _table.assign(newSize, 0);
+        for (size_t i = 0; i < _entries.size(); i++)
+        {
+            size_t slot = _entries[i].Hash & (newSize - 1);
+            while (_table[slot] != 0)
+                slot = (slot + 1) & (newSize - 1);
+            _table[slot] = (uint32_t)(i + 1);
+        }
+    }
+
+    size_t slot = FindSlot(entry.Section, entry.Key, entry.Hash);
+    if (_table[slot] != 0)
+        return; // The first key wins
+    _entries.push_back(entry);
+    _table[slot] = (uint32_t)_entries.size();
+}
+
+// Returns the slot of the key or the empty slot where it should be
+size_t CIniFile::FindSlot(const SStringRef &section, const SStringRef &key, uint32_t hash) const
+{
+    size_t mask = _table.size() - 1;
+    size_t slot = hash & mask;
+    while (_table[slot] != 0)
+    {
+        const SEntry &entry = _entries[_table[slot] - 1];
+        if (entry.Hash == hash && EqualNames(entry.Key, key) &&
+            EqualNames(entry.Section, section))
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+bool CIniFile::Find(const char *section, const char *key, SStringRef *value) const
+{
+    if (_table.empty())
+        return false;
+
+    SStringRef sectionRef = MakeRef(section);
+    SStringRef keyRef = MakeRef(key);
+    uint32_t index = _table[FindSlot(sectionRef, keyRef, GetHash(sectionRef, keyRef))];
+    if (index == 0)
+        return false;
+    *value = _entries[index - 1].Value;
+    return true;
+}
+
+std::string CIniFile::GetString(const char *section, const char *key,
+                                const std::string &defaultValue) const
+{
+    SStringRef value;
+    return Find(section, key, &value) ? value.ToString() : defaultValue;
+}
+
+int CIniFile::GetInt(const char *section, const char *key, int defaultValue) const
+{
+    SStringRef value;
+    return Find(section, key, &value) ? ParseIntPrefix(value) : defaultValue;
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// In-memory INI file.
+//
+// The file is read once and parsed in a single pass into a hash table of
+// section/key pairs which refer to the file buffer, so a lookup doesn't touch
+// the disk. It follows GetPrivateProfileString rules: names are case
+// insensitive, spaces around names and values are trimmed, a pair of quotes
+// around a value is removed, lines starting with ';' are comments and the
+// first of duplicate sections or keys wins.
+//
+
+namespace Ini {
+
+// Part of the file buffer, not null terminated
+struct SStringRef
+{
+    const char *Data;
+    size_t Size;
+
+    std::string ToString() const { return std::string(Data, Size); }
+};
+
+const uint32_t FnvOffset = 2166136261u;
+const uint32_t FnvPrime = 16777619u;
+
+constexpr char ToLowerAscii(char c)
+{
+    return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+}
+
+// One step of FNV-1a. The product is 64-bit, so a constant expression doesn't overflow
+constexpr uint32_t HashByte(uint32_t hash, uint8_t value)
+{
+    return (uint32_t)((uint64_t)(hash ^ value) * FnvPrime);
+}
+
+// FNV-1a of a lowercase name
+constexpr uint32_t HashName(const char *str, uint32_t hash = FnvOffset)
+{
+    return *str == '\0' ? hash : HashName(str + 1, HashByte(hash, (uint8_t)ToLowerAscii(*str)));
+}
+
+// Hash of a section/key pair, the same as CIniFile uses. It can be computed at compile time
+constexpr uint32_t HashKey(const char *section, const char *key)
+{
+    return HashName(key, HashByte(HashName(section), 0xFF));
+}
+
+bool EqualNoCase(const SStringRef &str, const char *name);
+
+// Whole values must match, these return false if there is anything else
+bool ParseInt(const SStringRef &str, int *result); // Decimal or 0x hexadecimal
+bool ParseUInt(const SStringRef &str, uint32_t *result);
+bool ParseBool(const SStringRef &str, bool *result); // 1/0, true/false, yes/no, on/off
+
+// Stops at the first character which isn't a digit, as GetPrivateProfileInt does. Returns 0 if
+// there are no digits
+int ParseIntPrefix(const SStringRef &str);
+
+class CIniFile
+{
+public:
+    struct SEntry
+    {
+        SStringRef Section;
+        SStringRef Key;
+        SStringRef Value;
+        uint32_t Hash; // HashKey of the section and the key
+    };
+
+    // Returns false if the file can't be read, all lookups return defaults then
+    bool Load(const char *filename);
+    void Parse(const char *data, size_t size);
+
+    bool Find(const char *section, const char *key, SStringRef *value) const;
+    size_t GetKeyCount() const { return _entries.size(); }
+
+    // Keys in the order of the file
+    const SEntry &GetEntry(size_t index) const { return _entries[index]; }
+
+    std::string GetString(const char *section, const char *key,
+                          const std::string &defaultValue) const;
+
+    // Decimal or hexadecimal (0x...) number, 0 if the value isn't a number
+    int GetInt(const char *section, const char *key, int defaultValue) const;
+
+private:
+    std::vector<char> _data;
+    std::vector<SEntry> _entries;
+    std::vector<uint32_t> _table; // Entry index + 1, 0 for empty slots
+
+    void ParseData();
+    void AddEntry(const SEntry &entry);
+    size_t FindSlot(const SStringRef &section, const SStringRef &key, uint32_t hash) const;
+};
+
+} // namespace Ini
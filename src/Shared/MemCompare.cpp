@@ -0,0 +1,87 @@
+#include "Common.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SSE2_TARGET
+#else
+#include <cpuid.h>
+#include <emmintrin.h>
+#define SSE2_TARGET __attribute__((target("sse2")))
+#endif
+
+namespace {
+
+const size_t BlockSize = 16;
+
+bool HasSse2()
+{
+    // Races only make it computed more than once
+    static int result = -1;
+    if (result < 0)
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        result = (info[3] >> 26) & 1;
+#else
+        unsigned eax, ebx, ecx, edx;
+        result = __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2) != 0;
+#endif
+    }
+    return result != 0;
+}
+
+unsigned CountTrailingZeros(uint32_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return index;
+#else
+    return __builtin_ctz(value);
+#endif
+}
+
+// Finds the first byte which is equal in a and b if equal is true, or which differs otherwise
+size_t FindScalar(const uint8_t *a, const uint8_t *b, size_t size, bool equal)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        if ((a[i] == b[i]) == equal)
+            return i;
+    }
+    return size;
+}
+
+SSE2_TARGET size_t FindSse2(const uint8_t *a, const uint8_t *b, size_t size, bool equal)
+{
+    uint32_t flip = equal ? 0 : 0xFFFF;
+    size_t i = 0;
+    for (; i + BlockSize <= size; i += BlockSize)
+    {
+        __m128i x = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i y = _mm_loadu_si128((const __m128i *)(b + i));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) ^ flip;
+        if (mask != 0)
+            return i + CountTrailingZeros(mask);
+    }
+    return i + FindScalar(a + i, b + i, size - i, equal);
+}
+
+size_t Find(const void *a, const void *b, size_t size, bool equal)
+{
+    if (size >= BlockSize && HasSse2())
+        return FindSse2((const uint8_t *)a, (const uint8_t *)b, size, equal);
+    return FindScalar((const uint8_t *)a, (const uint8_t *)b, size, equal);
+}
+
+} // namespace
+
+size_t Common::FindMismatch(const void *a, const void *b, size_t size)
+{
+    return Find(a, b, size, false);
+}
+
+size_t Common::FindMatch(const void *a, const void *b, size_t size)
+{
+    return Find(a, b, size, true);
+}
@@ -0,0 +1,156 @@
+#include "PatchImage.h"
+#include "Common.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace PatchImage;
+
+namespace {
+
+const uint32_t ImageMagic = 0x474D4950; // "PIMG"
+const uint32_t ImageVersion = 2;
+const size_t ImageAlignment = 16;
+
+static_assert(sizeof(SImageHeader) == 64, "Tables must be aligned");
+static_assert(sizeof(SImagePatch) == ImageAlignment && sizeof(SImageRun) == ImageAlignment,
+              "Tables must be aligned");
+
+template <class T>
+void Append(std::vector<uint8_t> &buffer, const T &value)
+{
+    buffer.insert(buffer.end(), (const uint8_t *)&value, (const uint8_t *)(&value + 1));
+}
+
+} // namespace
+
+void CImageBuilder::BeginPatch(const char *name)
+{
+    _patches.push_back(SPatch());
+    _patches.back().Name = name;
+}
+
+void CImageBuilder::AddWrite(uint32_t addr, const uint8_t *newBytes, const uint8_t *oldBytes,
+                             size_t size)
+{
+    auto &writes = _patches.back().Writes;
+    for (size_t i = 0; i < size; i++)
+    {
+        SWrite write = {addr + (uint32_t)i, newBytes[i], oldBytes[i]};
+        writes.push_back(write);
+    }
+}
+
+void CImageBuilder::Write(const SImageStamp &stamp, std::vector<uint8_t> &result)
+{
+    std::vector<SImagePatch> patches;
+    std::vector<SImageRun> runs;
+    std::vector<uint8_t> data;
+    for (auto patch = _patches.begin(); patch != _patches.end(); ++patch)
+    {
+        // A later write of the same byte wins, as it does when a patch is applied
+        auto &writes = patch->Writes;
+        std::stable_sort(writes.begin(), writes.end(),
+                         [](const SWrite &a, const SWrite &b) { return a.Addr < b.Addr; });
+
+        SImagePatch entry = {(uint32_t)data.size(), (uint32_t)runs.size(), 0, 0};
+        data.insert(data.end(), patch->Name.c_str(), patch->Name.c_str() + patch->Name.size() + 1);
+
+        std::vector<uint8_t> newBytes, oldBytes;
+        for (size_t i = 0; i < writes.size(); i++)
+        {
+            if (i + 1 < writes.size() && writes[i + 1].Addr == writes[i].Addr)
+                continue;
+            newBytes.push_back(writes[i].New);
+            oldBytes.push_back(writes[i].Old);
+
+            // A run ends at a gap and at a page boundary
+            bool last = i + 1 == writes.size();
+            uint32_t next = writes[i].Addr + 1;
+            if (last || writes[i + 1].Addr != next || next % RunPageSize == 0)
+            {
+                SImageRun run = {next - (uint32_t)newBytes.size(), (uint32_t)newBytes.size(),
+                                 (uint32_t)data.size(), (uint32_t)(data.size() + newBytes.size())};
+                data.insert(data.end(), newBytes.begin(), newBytes.end());
+                data.insert(data.end(), oldBytes.begin(), oldBytes.end());
+                runs.push_back(run);
+                entry.RunCount++;
+                newBytes.clear();
+                oldBytes.clear();
+            }
+        }
+        patches.push_back(entry);
+    }
+
+    std::vector<uint8_t> body;
+    for (size_t i = 0; i < patches.size(); i++)
+        Append(body, patches[i]);
+    for (size_t i = 0; i < runs.size(); i++)
+        Append(body, runs[i]);
+    body.insert(body.end(), data.begin(), data.end());
+
+    SImageHeader header = {};
+    header.Magic = ImageMagic;
+    header.Version = ImageVersion;
+    header.Stamp = stamp;
+    header.PatchCount = (uint32_t)patches.size();
+    header.RunCount = (uint32_t)runs.size();
+    header.DataSize = (uint32_t)data.size();
+    header.Crc = Common::GetCrc32(body.data(), body.size());
+
+    result.clear();
+    Append(result, header);
+    result.insert(result.end(), body.begin(), body.end());
+    _runCount = runs.size();
+}
+
+bool CPatchImage::Parse(const uint8_t *data, size_t size)
+{
+    _header = nullptr;
+    if (size < sizeof(SImageHeader) || (uintptr_t)data % ImageAlignment != 0)
+        return false;
+
+    auto header = (const SImageHeader *)data;
+    uint64_t expectedSize = sizeof(SImageHeader) +
+                            (uint64_t)header->PatchCount * sizeof(SImagePatch) +
+                            (uint64_t)header->RunCount * sizeof(SImageRun) + header->DataSize;
+    if (header->Magic != ImageMagic || header->Version != ImageVersion || expectedSize != size)
+        return false;
+
+    auto patches = (const SImagePatch *)(header + 1);
+    auto runs = (const SImageRun *)(patches + header->PatchCount);
+    auto payload = (const uint8_t *)(runs + header->RunCount);
+    uint32_t dataSize = header->DataSize;
+
+    // Everything must refer inside the image
+    for (size_t i = 0; i < header->PatchCount; i++)
+    {
+        const SImagePatch &patch = patches[i];
+        if (patch.FirstRun > header->RunCount ||
+            patch.RunCount > header->RunCount - patch.FirstRun || patch.NameOffset >= dataSize ||
+            memchr(payload + patch.NameOffset, 0, dataSize - patch.NameOffset) == nullptr)
+        {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < header->RunCount; i++)
+    {
+        const SImageRun &run = runs[i];
+        if (run.Size == 0 || run.Size > dataSize || run.NewOffset > dataSize - run.Size ||
+            run.OldOffset > dataSize - run.Size)
+        {
+            return false;
+        }
+    }
+
+    _header = header;
+    _patches = patches;
+    _runs = runs;
+    _data = payload;
+    return true;
+}
+
+bool CPatchImage::VerifyCrc() const
+{
+    auto body = (const uint8_t *)(_header + 1);
+    return _header->Crc == Common::GetCrc32(body, (size_t)(_data + _header->DataSize - body));
+}
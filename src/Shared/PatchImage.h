@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Precomputed patches for one game executable and one config.
+//
+// The image is built offline by patchc. Every patch is a list of runs sorted
+// by address, a run never crosses a page. Runs hold the new bytes and the
+// original bytes expected under them. A CRC32 covers everything after the
+// header, so a damaged file isn't applied.
+//
+// The file is a 64-byte header, the patch table, the run table and the
+// payload. Tables have 16-byte entries and the payload starts at a 16-byte
+// boundary, so a mapped file is used in place: Parse only checks bounds and
+// runs point straight into the mapping.
+//
+
+namespace PatchImage {
+
+const uint32_t RunPageSize = 4096;
+
+// The executable and the config the image was built for
+struct SImageStamp
+{
+    uint32_t ExeTimeStamp; // TimeDateStamp of the PE file header
+    uint32_t ExeImageSize;
+    uint32_t ConfigHash; // SPluginConfig::GetHash
+};
+
+struct SRunView
+{
+    uint32_t Addr;
+    uint32_t Size;
+    const uint8_t *NewBytes;
+    const uint8_t *OldBytes;
+};
+
+class CImageBuilder
+{
+public:
+    CImageBuilder()
+        : _runCount(0)
+    {
+    }
+
+    // Writes of a patch follow its BeginPatch
+    void BeginPatch(const char *name);
+    void AddWrite(uint32_t addr, const uint8_t *newBytes, const uint8_t *oldBytes, size_t size);
+
+    size_t GetPatchCount() const { return _patches.size(); }
+    size_t GetRunCount() const { return _runCount; }
+
+    void Write(const SImageStamp &stamp, std::vector<uint8_t> &result);
+
+private:
+    struct SWrite
+    {
+        uint32_t Addr;
+        uint8_t New;
+        uint8_t Old;
+    };
+
+    struct SPatch
+    {
+        std::string Name;
+        std::vector<SWrite> Writes;
+    };
+
+    std::vector<SPatch> _patches;
+    size_t _runCount;
+};
+
+struct SImageHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    SImageStamp Stamp;
+    uint32_t PatchCount;
+    uint32_t RunCount;
+    uint32_t DataSize;
+    uint32_t Crc; // Of everything after the header
+    uint32_t Reserved[7];
+};
+
+struct SImagePatch
+{
+    uint32_t NameOffset; // Null terminated string in the payload
+    uint32_t FirstRun;
+    uint32_t RunCount;
+    uint32_t Reserved;
+};
+
+struct SImageRun
+{
+    uint32_t Addr;
+    uint32_t Size;
+    uint32_t NewOffset; // In the payload
+    uint32_t OldOffset;
+};
+
+// Refers to the data passed to Parse, it must outlive the image. The data must be 16-byte
+// aligned, as a mapped file is
+class CPatchImage
+{
+public:
+    CPatchImage()
+        : _header(nullptr)
+        , _patches(nullptr)
+        , _runs(nullptr)
+        , _data(nullptr)
+    {
+    }
+
+    // Returns false if the data isn't a valid image. It only checks the tables, the payload is
+    // checked by VerifyCrc
+    bool Parse(const uint8_t *data, size_t size);
+    bool VerifyCrc() const;
+
+    const SImageStamp &GetStamp() const { return _header->Stamp; }
+    size_t GetPatchCount() const { return _header != nullptr ? _header->PatchCount : 0; }
+    const char *GetPatchName(size_t patch) const
+    {
+        return (const char *)_data + _patches[patch].NameOffset;
+    }
+    size_t GetRunCount(size_t patch) const { return _patches[patch].RunCount; }
+
+    SRunView GetRun(size_t patch, size_t run) const
+    {
+        const SImageRun &entry = _runs[_patches[patch].FirstRun + run];
+        SRunView result = {entry.Addr, entry.Size, _data + entry.NewOffset,
+                           _data + entry.OldOffset};
+        return result;
+    }
+
+private:
+    const SImageHeader *_header;
+    const SImagePatch *_patches;
+    const SImageRun *_runs;
+    const uint8_t *_data;
+};
+
+} // namespace PatchImage
@@ -5,6 +5,7 @@
 #include <cstdlib>
 #include <cstring>
 #include <algorithm>
+#include <map>
 #include <vector>
 
 #if !defined(_M_IX86) && !defined(__i386__)
@@ -201,6 +202,7 @@ struct SPatch
 {
     const char *const Name;
     std::vector<SPatchChunk> Chunks;
+    std::vector<SPatchChunk> Expected; // Original bytes under the patch, see Expect
 
     SPatch(const char *name = "")
         : Name(name)
@@ -402,6 +404,21 @@ struct SPatch
     size_t WriteMov(ERegisterName reg, uint32_t value) { return WriteMov(GetAddr(), reg, value); }
     // clang-format on
 
+    // Declares bytes the game must have before the patch is written. A patch made for another
+    // game version or for code changed by another mod isn't written then
+    void Expect(void *addr, const void *data, size_t size)
+    {
+        Expected.push_back(SPatchChunk(addr, data, size));
+    }
+
+    template <size_t Size>
+    void Expect(void *addr, const uint8_t (&data)[Size])
+    {
+        Expect(addr, data, Size);
+    }
+
+    void ExpectByte(void *addr, uint8_t value) { Expect(addr, &value, sizeof(value)); }
+
 private:
     bool _finished;
 
@@ -442,4 +459,150 @@ private:
 #pragma warning(pop)
 #endif
 
+// Copies patched bytes to their places. The memory must be writable
+static inline void ApplyPatch(const SPatch &patch)
+{
+    for (auto it = patch.Chunks.cbegin(); it != patch.Chunks.cend(); ++it)
+    {
+        if (!it->Data.empty())
+            memcpy(it->Addr, &it->Data[0], it->Data.size());
+    }
+}
+
+// A chunk whose bytes are owned by someone else, e.g. by SPatch or by a mapped
+// patch image
+struct SChunkRef
+{
+    uint8_t *Addr;
+    const uint8_t *Data;
+    size_t Size;
+};
+
+static inline void GetChunkRefs(const std::vector<SPatchChunk> &chunks,
+                                std::vector<SChunkRef> &refs)
+{
+    for (auto it = chunks.cbegin(); it != chunks.cend(); ++it)
+    {
+        if (!it->Data.empty())
+        {
+            SChunkRef ref = {it->Addr, &it->Data[0], it->Data.size()};
+            refs.push_back(ref);
+        }
+    }
+}
+
+// Saves the bytes under the chunks to backup, so ReapplyPatch can restore them
+static inline void BackupChunks(const std::vector<SChunkRef> &chunks, SPatch &backup)
+{
+    for (auto it = chunks.cbegin(); it != chunks.cend(); ++it)
+        backup.Write(it->Addr, it->Addr, it->Size);
+}
+
+// Writes the bytes by aligned words, a word is stored at once together with the bytes around
+// them. A running thread never sees a half written pointer or an operand which fits in a word
+static inline void StoreBytes(uint8_t *addr, const uint8_t *data, size_t size)
+{
+    uint8_t *end = addr + size;
+    for (auto word = (uint8_t *)((uintptr_t)addr & ~(uintptr_t)3); word < end; word += 4)
+    {
+        uint32_t value = ReadU32(word);
+        auto bytes = (uint8_t *)&value;
+        for (size_t i = 0; i < 4; i++)
+        {
+            if (word + i >= addr && word + i < end)
+                bytes[i] = data[word + i - addr];
+        }
+        GetVarU32(word) = value;
+    }
+}
+
+// Bytes under the previous and the new patch after ReapplyPatch
+static inline void GetReappliedBytes(const SPatch &patch, const SPatch &backup,
+                                     std::map<uint8_t *, uint8_t> &bytes)
+{
+    for (auto it = backup.Chunks.cbegin(); it != backup.Chunks.cend(); ++it)
+    {
+        for (size_t i = 0; i < it->Data.size(); i++)
+            bytes[it->Addr + i] = it->Data[i];
+    }
+    for (auto it = patch.Chunks.cbegin(); it != patch.Chunks.cend(); ++it)
+    {
+        for (size_t i = 0; i < it->Data.size(); i++)
+            bytes[it->Addr + i] = it->Data[i];
+    }
+}
+
+// Returns true if ReapplyPatch changes bytes under every chunk of the patch and of the backup
+// with one store: the changed bytes of a chunk are inside one aligned word. A thread running
+// the code sees either the old or the new instruction then
+static inline bool IsReapplyAtomic(const SPatch &patch, const SPatch &backup)
+{
+    std::map<uint8_t *, uint8_t> bytes;
+    GetReappliedBytes(patch, backup, bytes);
+    const std::vector<SPatchChunk> *lists[] = {&patch.Chunks, &backup.Chunks};
+    for (size_t n = 0; n < 2; n++)
+    {
+        for (auto it = lists[n]->cbegin(); it != lists[n]->cend(); ++it)
+        {
+            uintptr_t word = UINTPTR_MAX;
+            for (size_t i = 0; i < it->Data.size(); i++)
+            {
+                uint8_t *addr = it->Addr + i;
+                if (*addr == bytes[addr])
+                    continue;
+                if (word != UINTPTR_MAX && (uintptr_t)addr / 4 != word)
+                    return false;
+                word = (uintptr_t)addr / 4;
+            }
+        }
+    }
+    return true;
+}
+
+// Replaces a previously applied patch with a new one writing only bytes which
+// differ. backup holds the original bytes under the previous patch (it's empty
+// if nothing was applied), bytes which the new patch doesn't cover are restored
+// from it. Then it's replaced with the original bytes under the new patch.
+// The memory must be writable
+static inline void ReapplyPatch(const SPatch &patch, SPatch &backup)
+{
+    std::map<uint8_t *, uint8_t> bytes;
+    for (auto it = backup.Chunks.cbegin(); it != backup.Chunks.cend(); ++it)
+    {
+        for (size_t i = 0; i < it->Data.size(); i++)
+            bytes[it->Addr + i] = it->Data[i];
+    }
+
+    SPatch newBackup;
+    for (auto it = patch.Chunks.cbegin(); it != patch.Chunks.cend(); ++it)
+    {
+        for (size_t i = 0; i < it->Data.size(); i++)
+        {
+            uint8_t *addr = it->Addr + i;
+            auto orig = bytes.find(addr);
+            newBackup.WriteByte(addr, orig != bytes.end() ? orig->second : *addr);
+            bytes[addr] = it->Data[i];
+        }
+    }
+    newBackup.Finish();
+
+    // A run of bytes starting with a changed one is stored by words, so the running game
+    // never sees a half written pointer, e.g. in an IAT or a vtable slot
+    std::vector<uint8_t> run;
+    for (auto it = bytes.cbegin(); it != bytes.cend();)
+    {
+        if (*it->first == it->second)
+        {
+            ++it;
+            continue;
+        }
+        uint8_t *start = it->first;
+        run.clear();
+        for (; it != bytes.cend() && it->first == start + run.size(); ++it)
+            run.push_back(it->second);
+        StoreBytes(start, &run[0], run.size());
+    }
+    backup.Chunks.swap(newBackup.Chunks);
+}
+
 } // namespace Patcher
@@ -0,0 +1,335 @@
+#include "PeImage.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+
+using namespace PeImage;
+
+namespace {
+
+const uint16_t DosSignature = 0x5A4D;     // "MZ"
+const uint32_t PeSignature = 0x00004550;  // "PE\0\0"
+const uint16_t Pe32Magic = 0x10B;
+const size_t SectionHeaderSize = 40;
+const size_t MaxDirectories = 16;
+const size_t ImportDescriptorSize = 20;
+const uint32_t OrdinalFlag = 0x80000000;
+
+enum EDirectory
+{
+    DIR_EXPORT = 0,
+    DIR_IMPORT = 1,
+    DIR_RELOCATION = 5,
+};
+
+enum ERelocation
+{
+    REL_ABSOLUTE = 0, // Padding
+    REL_HIGHLOW = 3,
+};
+
+uint32_t GetU32(const uint8_t *data, size_t size, size_t offset)
+{
+    uint32_t result = 0;
+    if (offset <= size && size - offset >= sizeof(result))
+        memcpy(&result, data + offset, sizeof(result));
+    return result;
+}
+
+uint16_t GetU16(const uint8_t *data, size_t size, size_t offset)
+{
+    uint16_t result = 0;
+    if (offset <= size && size - offset >= sizeof(result))
+        memcpy(&result, data + offset, sizeof(result));
+    return result;
+}
+
+// Module names differ in case between linkers
+bool SameModule(const std::string &a, const char *b)
+{
+    size_t i = 0;
+    for (; i < a.size() && b[i] != 0; i++)
+    {
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    }
+    return i == a.size() && b[i] == 0;
+}
+
+} // namespace
+
+bool CPeImage::ParseModule(const void *base)
+{
+    // Headers of a loaded module are valid
+    auto data = (const uint8_t *)base;
+    uint32_t nt;
+    uint32_t imageSize;
+    memcpy(&nt, data + 0x3C, sizeof(nt));
+    memcpy(&imageSize, data + nt + 24 + 56, sizeof(imageSize));
+    return Parse(data, imageSize, true);
+}
+
+bool CPeImage::Parse(const uint8_t *data, size_t size, bool mapped)
+{
+    _sections.clear();
+    _directories.clear();
+    _data = nullptr;
+
+    uint32_t nt = GetU32(data, size, 0x3C);
+    if (GetU16(data, size, 0) != DosSignature || GetU32(data, size, nt) != PeSignature)
+        return false;
+
+    size_t fileHeader = (size_t)nt + 4;
+    uint16_t sectionCount = GetU16(data, size, fileHeader + 2);
+    uint16_t optionalSize = GetU16(data, size, fileHeader + 16);
+    size_t optional = fileHeader + 20;
+    if (GetU16(data, size, optional) != Pe32Magic || optionalSize < 96)
+        return false;
+
+    _timeStamp = GetU32(data, size, fileHeader + 4);
+    _entryPoint = GetU32(data, size, optional + 16);
+    _imageBase = GetU32(data, size, optional + 28);
+    _imageSize = GetU32(data, size, optional + 56);
+    _headersSize = GetU32(data, size, optional + 60);
+
+    size_t directoryCount = std::min((size_t)GetU32(data, size, optional + 92), MaxDirectories);
+    directoryCount = std::min(directoryCount, (size_t)(optionalSize - 96) / 8);
+    for (size_t i = 0; i < directoryCount; i++)
+    {
+        SDirectory directory = {GetU32(data, size, optional + 96 + i * 8),
+                                GetU32(data, size, optional + 100 + i * 8)};
+        _directories.push_back(directory);
+    }
+
+    size_t header = optional + optionalSize;
+    for (uint16_t i = 0; i < sectionCount; i++, header += SectionHeaderSize)
+    {
+        if (header > size || size - header < SectionHeaderSize)
+            return false;
+        SSection section;
+        memcpy(section.Name, data + header, 8);
+        section.Name[8] = 0;
+        section.Size = GetU32(data, size, header + 8);
+        section.Rva = GetU32(data, size, header + 12);
+        section.RawSize = GetU32(data, size, header + 16);
+        section.RawOffset = GetU32(data, size, header + 20);
+        section.Characteristics = GetU32(data, size, header + 36);
+        if (section.Size == 0)
+            section.Size = section.RawSize;
+        _sections.push_back(section);
+    }
+    std::sort(_sections.begin(), _sections.end(),
+              [](const SSection &a, const SSection &b) { return a.Rva < b.Rva; });
+
+    _data = data;
+    _size = size;
+    _mapped = mapped;
+    return true;
+}
+
+const SSection *CPeImage::FindSection(uint32_t rva) const
+{
+    auto it = std::upper_bound(_sections.cbegin(), _sections.cend(), rva,
+                               [](uint32_t value, const SSection &s) { return value < s.Rva; });
+    if (it == _sections.cbegin())
+        return nullptr;
+    --it;
+    return rva - it->Rva < it->Size ? &*it : nullptr;
+}
+
+const SSection *CPeImage::FindSection(const char *name) const
+{
+    for (auto it = _sections.cbegin(); it != _sections.cend(); ++it)
+    {
+        if (strcmp(it->Name, name) == 0)
+            return &*it;
+    }
+    return nullptr;
+}
+
+const uint8_t *CPeImage::GetData(uint32_t rva, size_t size) const
+{
+    // Headers are at the same offsets in both layouts
+    size_t offset = rva, available = 0;
+    if (_mapped || rva < _headersSize)
+    {
+        available = _mapped ? _size : std::min((size_t)_headersSize, _size);
+    }
+    else
+    {
+        const SSection *section = FindSection(rva);
+        if (section == nullptr || rva - section->Rva >= section->RawSize)
+            return nullptr;
+        offset = (size_t)section->RawOffset + (rva - section->Rva);
+        available = std::min((size_t)section->RawOffset + section->RawSize, _size);
+    }
+    if (offset > available || size > available - offset)
+        return nullptr;
+    return _data + offset;
+}
+
+bool CPeImage::ReadU32(uint32_t rva, uint32_t &value) const
+{
+    const uint8_t *data = GetData(rva, sizeof(value));
+    if (data != nullptr)
+        memcpy(&value, data, sizeof(value));
+    return data != nullptr;
+}
+
+bool CPeImage::ReadU16(uint32_t rva, uint16_t &value) const
+{
+    const uint8_t *data = GetData(rva, sizeof(value));
+    if (data != nullptr)
+        memcpy(&value, data, sizeof(value));
+    return data != nullptr;
+}
+
+bool CPeImage::ReadString(uint32_t rva, std::string &value) const
+{
+    value.clear();
+    for (;; rva++)
+    {
+        const uint8_t *data = GetData(rva, 1);
+        if (data == nullptr)
+            return false;
+        if (*data == 0)
+            return true;
+        value += (char)*data;
+    }
+}
+
+CPeImage::SDirectory CPeImage::GetDirectory(size_t index) const
+{
+    SDirectory none = {0, 0};
+    return index < _directories.size() ? _directories[index] : none;
+}
+
+bool CPeImage::ReadImports(std::vector<SImport> &imports) const
+{
+    imports.clear();
+    SDirectory directory = GetDirectory(DIR_IMPORT);
+    if (directory.Rva == 0)
+        return true;
+
+    for (uint32_t descriptor = directory.Rva;; descriptor += ImportDescriptorSize)
+    {
+        uint32_t lookup, name, iat;
+        if (!ReadU32(descriptor, lookup) || !ReadU32(descriptor + 12, name) ||
+            !ReadU32(descriptor + 16, iat))
+        {
+            return false;
+        }
+        if (name == 0 && iat == 0)
+            return true;
+
+        SImport import;
+        if (!ReadString(name, import.Module))
+            return false;
+
+        // Without the lookup table, the IAT of a loaded module holds only addresses
+        bool named = lookup != 0 || !_mapped;
+        uint32_t thunks = lookup != 0 ? lookup : iat;
+        for (uint32_t i = 0;; i++)
+        {
+            uint32_t thunk;
+            if (!ReadU32(thunks + i * 4, thunk))
+                return false;
+            if (thunk == 0)
+                break;
+
+            import.Name.clear();
+            import.Ordinal = 0;
+            import.IatRva = iat + i * 4;
+            if (named && (thunk & OrdinalFlag) != 0)
+                import.Ordinal = (uint16_t)thunk;
+            else if (named && !ReadString(thunk + 2, import.Name))
+                return false;
+            imports.push_back(import);
+        }
+    }
+}
+
+bool CPeImage::ReadExports(std::vector<SExport> &exports) const
+{
+    exports.clear();
+    SDirectory directory = GetDirectory(DIR_EXPORT);
+    if (directory.Rva == 0)
+        return true;
+
+    uint32_t base, functionCount, nameCount, functions, names, ordinals;
+    if (!ReadU32(directory.Rva + 16, base) || !ReadU32(directory.Rva + 20, functionCount) ||
+        !ReadU32(directory.Rva + 24, nameCount) || !ReadU32(directory.Rva + 28, functions) ||
+        !ReadU32(directory.Rva + 32, names) || !ReadU32(directory.Rva + 36, ordinals) ||
+        functionCount > 0x10000 || nameCount > functionCount)
+    {
+        return false;
+    }
+
+    // Unused slots have no RVA
+    std::vector<size_t> positions(functionCount, functionCount);
+    for (uint32_t i = 0; i < functionCount; i++)
+    {
+        SExport entry;
+        entry.Ordinal = (uint16_t)(base + i);
+        if (!ReadU32(functions + i * 4, entry.Rva))
+            return false;
+        if (entry.Rva == 0)
+            continue;
+        if (entry.Rva - directory.Rva < directory.Size && !ReadString(entry.Rva, entry.Forwarder))
+            return false;
+        positions[i] = exports.size();
+        exports.push_back(entry);
+    }
+
+    for (uint32_t i = 0; i < nameCount; i++)
+    {
+        uint16_t index;
+        uint32_t name;
+        if (!ReadU16(ordinals + i * 2, index) || !ReadU32(names + i * 4, name) ||
+            index >= functionCount || positions[index] == functionCount ||
+            !ReadString(name, exports[positions[index]].Name))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CPeImage::ReadRelocations(std::vector<uint32_t> &relocations) const
+{
+    relocations.clear();
+    SDirectory directory = GetDirectory(DIR_RELOCATION);
+    for (uint32_t offset = 0; directory.Size - offset >= 8;)
+    {
+        uint32_t page, blockSize;
+        uint32_t block = directory.Rva + offset;
+        if (!ReadU32(block, page) || !ReadU32(block + 4, blockSize) || blockSize < 8 ||
+            blockSize > directory.Size - offset)
+        {
+            return false;
+        }
+
+        for (uint32_t entry = 8; entry + 2 <= blockSize; entry += 2)
+        {
+            uint16_t value;
+            if (!ReadU16(block + entry, value))
+                return false;
+            if (value >> 12 == REL_HIGHLOW)
+                relocations.push_back(page + (value & 0xFFF));
+            else if (value >> 12 != REL_ABSOLUTE)
+                return false; // Other types aren't used by 32-bit images
+        }
+        offset += blockSize;
+    }
+    return true;
+}
+
+void PeImage::FindImportSlots(const std::vector<SImport> &imports, const char *module,
+                              const char *function, std::vector<uint32_t> &slots)
+{
+    for (auto it = imports.cbegin(); it != imports.cend(); ++it)
+    {
+        if (it->Name == function && SameModule(it->Module, module))
+            slots.push_back(it->IatRva);
+    }
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//
+// Reader of 32-bit PE images.
+//
+// It reads a module loaded by Windows, where sections are at their RVAs, as
+// well as an exe file read or mapped as is on any platform. Parsing reads only
+// the headers and the section table. Imports, exports and relocations are read
+// on request. Nothing is copied, the data must outlive the image.
+//
+
+namespace PeImage {
+
+const uint32_t SectionCode = 0x00000020;
+const uint32_t SectionExecute = 0x20000000;
+const uint32_t SectionWrite = 0x80000000;
+
+struct SSection
+{
+    char Name[9]; // Null terminated
+    uint32_t Rva;
+    uint32_t Size; // Virtual size, or the raw one if it's 0
+    uint32_t RawOffset;
+    uint32_t RawSize;
+    uint32_t Characteristics;
+
+    bool IsExecutable() const { return (Characteristics & (SectionCode | SectionExecute)) != 0; }
+};
+
+struct SImport
+{
+    std::string Module;
+    std::string Name; // Empty if imported by ordinal
+    uint16_t Ordinal;
+    uint32_t IatRva; // Of the slot with the address of the function
+};
+
+struct SExport
+{
+    std::string Name; // Empty if exported by ordinal only
+    uint16_t Ordinal;
+    uint32_t Rva;
+    std::string Forwarder; // "Module.Function" if the export is forwarded, Rva is of it then
+};
+
+class CPeImage
+{
+public:
+    CPeImage()
+        : _data(nullptr)
+        , _size(0)
+        , _mapped(false)
+        , _imageBase(0)
+        , _imageSize(0)
+        , _headersSize(0)
+        , _timeStamp(0)
+        , _entryPoint(0)
+    {
+    }
+
+    // A module loaded by Windows, its size is taken from the headers
+    bool ParseModule(const void *base);
+    // mapped is true if sections are at their RVAs, false for the file as is
+    bool Parse(const uint8_t *data, size_t size, bool mapped);
+
+    uint32_t GetImageBase() const { return _imageBase; }
+    uint32_t GetImageSize() const { return _imageSize; }
+    uint32_t GetHeadersSize() const { return _headersSize; }
+    uint32_t GetTimeStamp() const { return _timeStamp; }
+    uint32_t GetEntryPoint() const { return _entryPoint; }
+
+    // Sorted by RVA
+    const std::vector<SSection> &GetSections() const { return _sections; }
+    // Returns nullptr if the RVA isn't inside a section, the search is binary
+    const SSection *FindSection(uint32_t rva) const;
+    const SSection *FindSection(const char *name) const;
+
+    // Returns nullptr if the range isn't inside the data
+    const uint8_t *GetData(uint32_t rva, size_t size) const;
+
+    // Return false if the tables are damaged
+    bool ReadImports(std::vector<SImport> &imports) const;
+    bool ReadExports(std::vector<SExport> &exports) const;
+    // RVAs of 32-bit absolute addresses fixed up when the image is moved
+    bool ReadRelocations(std::vector<uint32_t> &relocations) const;
+
+private:
+    struct SDirectory
+    {
+        uint32_t Rva;
+        uint32_t Size;
+    };
+
+    const uint8_t *_data;
+    size_t _size;
+    bool _mapped;
+    uint32_t _imageBase;
+    uint32_t _imageSize;
+    uint32_t _headersSize;
+    uint32_t _timeStamp;
+    uint32_t _entryPoint;
+    std::vector<SSection> _sections;
+    std::vector<SDirectory> _directories;
+
+    bool ReadU32(uint32_t rva, uint32_t &value) const;
+    bool ReadU16(uint32_t rva, uint16_t &value) const;
+    bool ReadString(uint32_t rva, std::string &value) const;
+    SDirectory GetDirectory(size_t index) const;
+};
+
+// Adds RVAs of the IAT slots of a function imported by name, a function may be imported more
+// than once. The module name is case insensitive
+void FindImportSlots(const std::vector<SImport> &imports, const char *module,
+                     const char *function, std::vector<uint32_t> &slots);
+
+} // namespace PeImage
@@ -0,0 +1,262 @@
+#include "PoolAllocator.h"
+#include "Common.h"
+#include <cassert>
+#include <cstring>
+
+using namespace PoolAllocator;
+
+uintptr_t PoolAllocator::PoolBase = 0;
+size_t PoolAllocator::PoolSize = 0;
+
+namespace {
+
+// The last class must be MaxBlockSize
+// clang-format off
+const uint16_t ClassSizes[] = {
+    16,  32,  48,  64,  80,  96,  112, 128, // 16 bytes step
+    160, 192, 224, 256,                     // 32 bytes step
+    320, 384, 448, 512,                     // 64 bytes step
+    640, 768, 896, 1024,                    // 128 bytes step
+};
+// clang-format on
+
+const size_t ClassCount = _countof(ClassSizes);
+const size_t BatchSize = 32;        // Blocks moved between thread and shared lists at once
+const size_t MaxCachedBlocks = 128; // Per class and thread
+
+struct SFreeBlock
+{
+    SFreeBlock *Next;
+};
+
+struct SThreadCache
+{
+    SFreeBlock *Lists[ClassCount];
+    size_t Counts[ClassCount];
+};
+
+struct SSizeClass
+{
+    volatile LONG Lock;
+    SFreeBlock *FreeList;
+    char *SpanCur; // Not carved yet part of the current span
+    char *SpanEnd;
+    char Padding[48]; // Keep locks of different classes in different cache lines
+};
+
+class CPool
+{
+public:
+    CPool()
+        : _tlsIndex(TLS_OUT_OF_INDEXES)
+        , _spanClasses(nullptr)
+        , _nextSpan(0)
+        , _spanCount(0)
+    {
+        memset(_classes, 0, sizeof(_classes));
+
+        // Maps (size + 15) / 16 to a size class
+        size_t cls = 0;
+        for (size_t i = 0; i < _countof(_classBySize); i++)
+        {
+            while (ClassSizes[cls] < i * 16)
+                cls++;
+            _classBySize[i] = (uint8_t)cls;
+        }
+    }
+
+    bool Init(size_t reserveSize)
+    {
+        assert(PoolBase == 0);
+        _tlsIndex = TlsAlloc();
+        if (_tlsIndex == TLS_OUT_OF_INDEXES)
+            return false;
+
+        reserveSize -= reserveSize % SpanSize;
+        void *base = VirtualAlloc(NULL, reserveSize, MEM_RESERVE, PAGE_NOACCESS);
+        if (base == nullptr)
+            return false;
+
+        _spanCount = reserveSize / SpanSize;
+        _spanClasses = new uint8_t[_spanCount]();
+        PoolBase = (uintptr_t)base;
+        PoolSize = reserveSize;
+        return true;
+    }
+
+    void *Alloc(size_t size)
+    {
+        if (size > MaxBlockSize)
+            return nullptr;
+        size_t cls = _classBySize[(size + 15) / 16];
+        SThreadCache *cache = GetCache();
+        if (cache == nullptr)
+            return nullptr;
+
+        SFreeBlock *block = cache->Lists[cls];
+        if (block == nullptr)
+        {
+            block = Refill(cache, cls);
+            if (block == nullptr)
+                return nullptr;
+        }
+        cache->Lists[cls] = block->Next;
+        cache->Counts[cls]--;
+        return block;
+    }
+
+    void Free(void *ptr)
+    {
+        assert(Owns(ptr));
+        size_t cls = GetClass(ptr);
+        SThreadCache *cache = GetCache();
+        if (cache == nullptr)
+        {
+            // Should never happen, but better than a leak
+            Release(cls, (SFreeBlock *)ptr, (SFreeBlock *)ptr);
+            return;
+        }
+
+        auto block = (SFreeBlock *)ptr;
+        block->Next = cache->Lists[cls];
+        cache->Lists[cls] = block;
+        if (++cache->Counts[cls] > MaxCachedBlocks)
+            ReleaseBatch(cache, cls);
+    }
+
+    size_t GetBlockSize(const void *ptr) { return ClassSizes[GetClass(ptr)]; }
+
+private:
+    DWORD _tlsIndex;
+    uint8_t *_spanClasses;
+    volatile LONG _nextSpan;
+    size_t _spanCount;
+    SSizeClass _classes[ClassCount];
+    uint8_t _classBySize[MaxBlockSize / 16 + 1];
+
+    size_t GetClass(const void *ptr) const
+    {
+        return _spanClasses[((uintptr_t)ptr - PoolBase) / SpanSize];
+    }
+
+    SThreadCache *GetCache()
+    {
+        // TlsGetValue always resets the last error, but the game may rely on it
+        DWORD lastError = GetLastError();
+        auto cache = (SThreadCache *)TlsGetValue(_tlsIndex);
+        if (cache == nullptr)
+        {
+            // Caches of finished threads are leaked. The game has just a few threads
+            cache = (SThreadCache *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY,
+                                              sizeof(SThreadCache));
+            if (cache != nullptr)
+                TlsSetValue(_tlsIndex, cache);
+        }
+        SetLastError(lastError);
+        return cache;
+    }
+
+    static void LockClass(SSizeClass &sc)
+    {
+        while (InterlockedExchange(&sc.Lock, 1) != 0)
+            YieldProcessor();
+    }
+
+    static void UnlockClass(SSizeClass &sc) { InterlockedExchange(&sc.Lock, 0); }
+
+    // Moves up to BatchSize blocks to the thread cache, returns the first one
+    SFreeBlock *Refill(SThreadCache *cache, size_t cls)
+    {
+        SSizeClass &sc = _classes[cls];
+        size_t blockSize = ClassSizes[cls];
+        SFreeBlock *first = nullptr;
+        size_t count = 0;
+
+        LockClass(sc);
+        while (count < BatchSize && sc.FreeList != nullptr)
+        {
+            SFreeBlock *block = sc.FreeList;
+            sc.FreeList = block->Next;
+            block->Next = first;
+            first = block;
+            count++;
+        }
+        while (count < BatchSize)
+        {
+            if (sc.SpanCur + blockSize > sc.SpanEnd && !NewSpan(sc, cls))
+                break;
+            auto block = (SFreeBlock *)sc.SpanCur;
+            sc.SpanCur += blockSize;
+            block->Next = first;
+            first = block;
+            count++;
+        }
+        UnlockClass(sc);
+
+        cache->Lists[cls] = first;
+        cache->Counts[cls] = count;
+        return first;
+    }
+
+    // Moves BatchSize blocks from the thread cache to the shared list
+    void ReleaseBatch(SThreadCache *cache, size_t cls)
+    {
+        SFreeBlock *first = cache->Lists[cls];
+        SFreeBlock *last = first;
+        for (size_t i = 1; i < BatchSize; i++)
+            last = last->Next;
+        cache->Lists[cls] = last->Next;
+        cache->Counts[cls] -= BatchSize;
+        Release(cls, first, last);
+    }
+
+    void Release(size_t cls, SFreeBlock *first, SFreeBlock *last)
+    {
+        SSizeClass &sc = _classes[cls];
+        LockClass(sc);
+        last->Next = sc.FreeList;
+        sc.FreeList = first;
+        UnlockClass(sc);
+    }
+
+    // Called with the class locked
+    bool NewSpan(SSizeClass &sc, size_t cls)
+    {
+        LONG index = InterlockedIncrement(&_nextSpan) - 1;
+        if ((size_t)index >= _spanCount)
+            return false;
+
+        char *span = (char *)PoolBase + index * SpanSize;
+        if (VirtualAlloc(span, SpanSize, MEM_COMMIT, PAGE_READWRITE) == nullptr)
+            return false;
+
+        _spanClasses[index] = (uint8_t)cls;
+        sc.SpanCur = span;
+        sc.SpanEnd = span + SpanSize;
+        return true;
+    }
+};
+
+} // namespace
+
+static CPool pool;
+
+bool PoolAllocator::Init(size_t reserveSize)
+{
+    return pool.Init(reserveSize);
+}
+
+void *PoolAllocator::Alloc(size_t size)
+{
+    return pool.Alloc(size);
+}
+
+void PoolAllocator::Free(void *ptr)
+{
+    pool.Free(ptr);
+}
+
+size_t PoolAllocator::GetBlockSize(const void *ptr)
+{
+    return pool.GetBlockSize(ptr);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// Thread-caching size-class allocator for small blocks.
+//
+// All blocks are carved from one reserved address range, so checking whether
+// a block belongs to the pool is a single comparison. Each 64 KB span of the
+// range holds blocks of one size class. Freed blocks go to a per-thread cache
+// first and are moved to the shared lists of the class in batches.
+//
+// Memory of the pool is never returned to the system.
+//
+
+namespace PoolAllocator {
+
+const size_t MaxBlockSize = 1024;
+const size_t SpanSize = 64 * 1024;
+
+// Reserves address space for the pool. Must be called once before any allocation
+bool Init(size_t reserveSize);
+
+// Returns nullptr if size is bigger than MaxBlockSize or the pool is exhausted
+void *Alloc(size_t size);
+
+// The block must belong to the pool
+void Free(void *ptr);
+
+// Returns usable size of a block which belongs to the pool
+size_t GetBlockSize(const void *ptr);
+
+extern uintptr_t PoolBase;
+extern size_t PoolSize;
+
+static inline bool Owns(const void *ptr)
+{
+    return (uintptr_t)ptr - PoolBase < PoolSize;
+}
+
+} // namespace PoolAllocator
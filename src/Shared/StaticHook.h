@@ -0,0 +1,132 @@
+#pragma once
+
+#include "Shared/Hook.h"
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+//
+// Function hooks with thunks generated by the compiler.
+//
+// If the calling convention and the signature of a target function are known
+// at compile time, the thunk which converts the convention of the source
+// function is instantiated from a template and lives in the plugin's own code
+// section. The size of arguments is taken from the signature. stdcall, cdecl
+// and thiscall with variable arguments need no thunk at all, the source
+// function jumps straight to the target.
+//
+// Target functions are declared the same way as for CreateFuncHook. Unlike
+// CreateFuncHook, ecx and edx are not preserved for the caller, and the
+// original function is called with its own convention (thiscall one can be
+// called as __fastcall with a dummy second argument).
+//
+// Installing such a hook generates no code at runtime, except the trampoline
+// to the original function if origFunc isn't null.
+//
+
+namespace SimpleHooker86 {
+
+bool CreateStaticFuncHook(void *sourceFunc, const void *thunk, void **origFunc,
+                          Patcher::SPatch &patch);
+
+bool CreateStaticFuncCallHook(void *callInstr, const void *thunk, Patcher::SPatch &patch);
+
+template <class Func>
+struct SDirectThunk
+{
+    template <Func Target>
+    static const void *Get()
+    {
+        return (const void *)Target;
+    }
+};
+
+template <ECallingConvention CallConv, class Func>
+struct SStaticThunk;
+
+template <class Ret, class... Args>
+struct SStaticThunk<CC_STDCALL, Ret(__stdcall *)(Args...)>
+    : SDirectThunk<Ret(__stdcall *)(Args...)>
+{
+};
+
+template <class Ret, class... Args>
+struct SStaticThunk<CC_CDECL, Ret(__cdecl *)(Args...)> : SDirectThunk<Ret(__cdecl *)(Args...)>
+{
+};
+
+template <class Ret, class... Args>
+struct SStaticThunk<CC_CDECL, Ret(__cdecl *)(Args..., ...)>
+    : SDirectThunk<Ret(__cdecl *)(Args..., ...)>
+{
+};
+
+template <class Ret, class This, class... Args>
+struct SStaticThunk<CC_THISCALL_VAR, Ret(__cdecl *)(This, Args...)>
+    : SDirectThunk<Ret(__cdecl *)(This, Args...)>
+{
+};
+
+template <class Ret, class This, class... Args>
+struct SStaticThunk<CC_THISCALL_VAR, Ret(__cdecl *)(This, Args..., ...)>
+    : SDirectThunk<Ret(__cdecl *)(This, Args..., ...)>
+{
+};
+
+// this comes in ecx, the rest of arguments are the same as for stdcall
+template <class Ret, class This, class... Args>
+struct SStaticThunk<CC_THISCALL, Ret(__stdcall *)(This, Args...)>
+{
+    template <Ret(__stdcall *Target)(This, Args...)>
+    static Ret __fastcall Thunk(This self, void *, Args... args)
+    {
+        return Target(self, args...);
+    }
+
+    template <Ret(__stdcall *Target)(This, Args...)>
+    static const void *Get()
+    {
+        return (const void *)&Thunk<Target>;
+    }
+};
+
+template <class Ret, class Arg0, class Arg1, class... Args>
+struct SStaticThunk<CC_FASTCALL, Ret(__stdcall *)(Arg0, Arg1, Args...)>
+{
+    template <Ret(__stdcall *Target)(Arg0, Arg1, Args...)>
+    static Ret __fastcall Thunk(Arg0 arg0, Arg1 arg1, Args... args)
+    {
+        return Target(arg0, arg1, args...);
+    }
+
+    template <Ret(__stdcall *Target)(Arg0, Arg1, Args...)>
+    static const void *Get()
+    {
+        return (const void *)&Thunk<Target>;
+    }
+};
+
+// Returns the return address of the hooked call. Valid in stdcall and cdecl
+// targets only, other ones are called from a thunk
+#ifdef _MSC_VER
+#define STATIC_HOOK_CALLER() _ReturnAddress()
+#else
+#define STATIC_HOOK_CALLER() __builtin_return_address(0)
+#endif
+
+} // namespace SimpleHooker86
+
+// Usage: CREATE_STATIC_FUNC_HOOK((void *)0x4A5D00, CC_THISCALL, MyHook, &origFunc, patch)
+#define CREATE_STATIC_FUNC_HOOK(sourceFunc, callConv, targetFunc, origFunc, patch)             \
+    SimpleHooker86::CreateStaticFuncHook(                                                      \
+        sourceFunc,                                                                            \
+        SimpleHooker86::SStaticThunk<SimpleHooker86::callConv,                                 \
+                                     decltype(&targetFunc)>::Get<&targetFunc>(),               \
+        origFunc, patch)
+
+#define CREATE_STATIC_FUNC_CALL_HOOK(callInstr, callConv, targetFunc, patch)                   \
+    SimpleHooker86::CreateStaticFuncCallHook(                                                  \
+        callInstr,                                                                             \
+        SimpleHooker86::SStaticThunk<SimpleHooker86::callConv,                                 \
+                                     decltype(&targetFunc)>::Get<&targetFunc>(),               \
+        patch)
@@ -0,0 +1,386 @@
+#include "Trace.h"
+#include "Common.h"
+#include <algorithm>
+#include <cassert>
+#include <map>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+using namespace Trace;
+
+#ifdef _MSC_VER
+#define COMPILER_BARRIER() _ReadWriteBarrier()
+#else
+#define COMPILER_BARRIER() __asm__ __volatile__("" ::: "memory")
+#endif
+
+static_assert((RingEventCount & (RingEventCount - 1)) == 0, "RingEventCount must be a power of 2");
+
+volatile bool Trace::Enabled = false;
+
+namespace {
+
+const DWORD DrainIntervalMs = 50;
+const DWORD StopTimeoutMs = 1000;
+const size_t WriteBufferSize = 1024 * 1024;
+
+struct SRing
+{
+    SRing *Next;
+    uint32_t ThreadId;
+    uint32_t DroppedReported; // Used by the drain thread only
+    char Padding0[64];
+    volatile uint32_t Head;    // Written by the owner thread only
+    volatile uint32_t Dropped; // Written by the owner thread only
+    char Padding1[64];
+    volatile uint32_t Tail; // Written by the drain thread only
+    char Padding2[64];
+    STraceEvent Events[RingEventCount];
+};
+
+class CTracer
+{
+public:
+    CTracer()
+        : _tlsIndex(TLS_OUT_OF_INDEXES)
+        , _rings(nullptr)
+        , _file(INVALID_HANDLE_VALUE)
+        , _thread(NULL)
+        , _stopEvent(NULL)
+        , _draining(0)
+        , _buffer(nullptr)
+        , _bufferUsed(0)
+        , _fileOffset(0)
+        , _eventCount(0)
+        , _startTicks(0)
+    {
+        InitializeCriticalSection(&_namesLock);
+    }
+
+    ~CTracer() { DeleteCriticalSection(&_namesLock); }
+
+    bool Start(const std::wstring &filename);
+    void Stop();
+
+    SRing *GetRing()
+    {
+        // TlsGetValue always resets the last error, but the game may rely on it
+        DWORD lastError = GetLastError();
+        auto ring = (SRing *)TlsGetValue(_tlsIndex);
+        if (ring == nullptr)
+            ring = CreateRing();
+        SetLastError(lastError);
+        return ring;
+    }
+
+    void SetHookName(uint16_t hookId, const char *name)
+    {
+        EnterCriticalSection(&_namesLock);
+        _names[hookId] = name;
+        LeaveCriticalSection(&_namesLock);
+    }
+
+    uint64_t GetDroppedCount()
+    {
+        uint64_t result = 0;
+        for (SRing *ring = _rings; ring != nullptr; ring = ring->Next)
+            result += ring->Dropped;
+        return result;
+    }
+
+private:
+    DWORD _tlsIndex;
+    SRing *volatile _rings;
+    HANDLE _file;
+    HANDLE _thread;
+    HANDLE _stopEvent;
+    volatile LONG _draining;
+    char *_buffer;
+    size_t _bufferUsed;
+    uint64_t _fileOffset;
+    uint64_t _eventCount;
+    uint64_t _startTicks;
+    LARGE_INTEGER _startQpc;
+    CRITICAL_SECTION _namesLock;
+    std::map<uint16_t, std::string> _names;
+
+    SRing *CreateRing()
+    {
+        auto ring = (SRing *)VirtualAlloc(NULL, sizeof(SRing), MEM_RESERVE | MEM_COMMIT,
+                                          PAGE_READWRITE);
+        if (ring == nullptr)
+            return nullptr;
+
+        ring->ThreadId = GetCurrentThreadId();
+        SRing *head;
+        do
+        {
+            head = _rings;
+            ring->Next = head;
+        } while (InterlockedCompareExchangePointer((void *volatile *)&_rings, ring, head) != head);
+
+        TlsSetValue(_tlsIndex, ring);
+        return ring;
+    }
+
+    bool Flush()
+    {
+        DWORD written;
+        BOOL res = WriteFile(_file, _buffer, _bufferUsed, &written, NULL);
+        bool result = res && written == _bufferUsed;
+        _fileOffset += res ? written : 0;
+        _bufferUsed = 0;
+        return result;
+    }
+
+    void Append(const void *data, size_t size)
+    {
+        while (size > 0)
+        {
+            size_t part = std::min(size, WriteBufferSize - _bufferUsed);
+            memcpy(_buffer + _bufferUsed, data, part);
+            _bufferUsed += part;
+            data = (const char *)data + part;
+            size -= part;
+            if (_bufferUsed == WriteBufferSize)
+                Flush();
+        }
+    }
+
+    void DrainRing(SRing *ring)
+    {
+        uint32_t tail = ring->Tail;
+        uint32_t head = ring->Head;
+        COMPILER_BARRIER(); // Read head before the events
+        uint32_t count = head - tail;
+        uint32_t first = tail & (RingEventCount - 1);
+        uint32_t firstPart = std::min<uint32_t>(count, RingEventCount - first);
+        Append(&ring->Events[first], firstPart * sizeof(STraceEvent));
+        Append(&ring->Events[0], (count - firstPart) * sizeof(STraceEvent));
+        _eventCount += count;
+        COMPILER_BARRIER(); // Copy the events before releasing them
+        ring->Tail = head;
+
+        uint32_t dropped = ring->Dropped;
+        if (dropped != ring->DroppedReported)
+        {
+            STraceEvent ev = {};
+            ev.Ticks = __rdtsc();
+            ev.ThreadId = ring->ThreadId;
+            ev.Kind = EK_DROPPED;
+            ev.ArgCount = 1;
+            ev.Args[0] = dropped - ring->DroppedReported;
+            Append(&ev, sizeof(ev));
+            _eventCount++;
+            ring->DroppedReported = dropped;
+        }
+    }
+
+    bool DrainAll()
+    {
+        // The drain thread might have been killed while draining on process exit
+        if (InterlockedExchange(&_draining, 1) != 0)
+            return false;
+        for (SRing *ring = _rings; ring != nullptr; ring = ring->Next)
+            DrainRing(ring);
+        Flush();
+        InterlockedExchange(&_draining, 0);
+        return true;
+    }
+
+    void WriteTrailer();
+
+    static DWORD WINAPI DrainThreadProc(LPVOID param)
+    {
+        auto self = (CTracer *)param;
+        while (WaitForSingleObject(self->_stopEvent, DrainIntervalMs) == WAIT_TIMEOUT)
+            self->DrainAll();
+        return 0;
+    }
+};
+
+} // namespace
+
+static CTracer tracer;
+
+bool CTracer::Start(const std::wstring &filename)
+{
+    assert(_file == INVALID_HANDLE_VALUE);
+
+    // Rings are never freed because a thread may still be inside Emit after Stop
+    if (_tlsIndex == TLS_OUT_OF_INDEXES)
+    {
+        _tlsIndex = TlsAlloc();
+        if (_tlsIndex == TLS_OUT_OF_INDEXES)
+            return false;
+    }
+
+    if (_buffer == nullptr)
+    {
+        _buffer = (char *)VirtualAlloc(NULL, WriteBufferSize, MEM_RESERVE | MEM_COMMIT,
+                                       PAGE_READWRITE);
+        if (_buffer == nullptr)
+            return false;
+    }
+
+    _file = CreateFileW(filename.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, NULL);
+    if (_file == INVALID_HANDLE_VALUE)
+        goto fail;
+
+    _stopEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (_stopEvent == NULL)
+        goto fail;
+
+    // Skip events left from the previous session
+    for (SRing *ring = _rings; ring != nullptr; ring = ring->Next)
+    {
+        ring->Tail = ring->Head;
+        ring->DroppedReported = ring->Dropped;
+    }
+
+    _bufferUsed = 0;
+    _fileOffset = 0;
+    _eventCount = 0;
+    QueryPerformanceCounter(&_startQpc);
+    _startTicks = __rdtsc();
+
+    STraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = FileMagic;
+    header.Version = FileVersion;
+    header.EventSize = sizeof(STraceEvent);
+    header.StartTicks = _startTicks;
+    Append(&header, sizeof(header));
+    if (!Flush())
+        goto fail;
+
+    _thread = CreateThread(NULL, 0, DrainThreadProc, this, 0, NULL);
+    if (_thread == NULL)
+        goto fail;
+    SetThreadPriority(_thread, THREAD_PRIORITY_BELOW_NORMAL);
+
+    Enabled = true;
+    return true;
+
+fail:
+    if (_stopEvent != NULL)
+        CloseHandle(_stopEvent);
+    if (_file != INVALID_HANDLE_VALUE)
+        CloseHandle(_file);
+    _stopEvent = NULL;
+    _file = INVALID_HANDLE_VALUE;
+    return false;
+}
+
+void CTracer::WriteTrailer()
+{
+    LARGE_INTEGER qpc, qpcFreq;
+    QueryPerformanceCounter(&qpc);
+    QueryPerformanceFrequency(&qpcFreq);
+    uint64_t ticks = __rdtsc();
+
+    STraceHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = FileMagic;
+    header.Version = FileVersion;
+    header.EventSize = sizeof(STraceEvent);
+    header.StartTicks = _startTicks;
+    header.EventCount = _eventCount;
+    header.DroppedCount = GetDroppedCount();
+    header.NamesOffset = _fileOffset;
+
+    // Calibrate the TSC against the performance counter over the whole session
+    double qpcElapsed = (double)(qpc.QuadPart - _startQpc.QuadPart);
+    if (qpcElapsed > 0)
+        header.TicksPerSecond = (uint64_t)((ticks - _startTicks) * (double)qpcFreq.QuadPart /
+                                           qpcElapsed);
+
+    EnterCriticalSection(&_namesLock);
+    for (auto it = _names.cbegin(); it != _names.cend(); ++it)
+    {
+        STraceName name;
+        name.HookId = it->first;
+        name.Length = (uint16_t)std::min<size_t>(it->second.length(), UINT16_MAX);
+        Append(&name, sizeof(name));
+        Append(it->second.c_str(), name.Length);
+        header.NameCount++;
+    }
+    LeaveCriticalSection(&_namesLock);
+    Flush();
+
+    SetFilePointer(_file, 0, NULL, FILE_BEGIN);
+    DWORD written;
+    WriteFile(_file, &header, sizeof(header), &written, NULL);
+}
+
+void CTracer::Stop()
+{
+    if (_file == INVALID_HANDLE_VALUE)
+        return;
+
+    Enabled = false;
+    SetEvent(_stopEvent);
+    // On process exit the thread is already terminated, so it doesn't hang here
+    WaitForSingleObject(_thread, StopTimeoutMs);
+    if (DrainAll())
+        WriteTrailer();
+
+    CloseHandle(_thread);
+    CloseHandle(_stopEvent);
+    CloseHandle(_file);
+    _thread = NULL;
+    _stopEvent = NULL;
+    _file = INVALID_HANDLE_VALUE;
+}
+
+bool Trace::Start(const std::wstring &filename)
+{
+    return tracer.Start(filename);
+}
+
+void Trace::Stop()
+{
+    tracer.Stop();
+}
+
+void Trace::SetHookName(uint16_t hookId, const char *name)
+{
+    tracer.SetHookName(hookId, name);
+}
+
+uint64_t Trace::GetDroppedCount()
+{
+    return tracer.GetDroppedCount();
+}
+
+void Trace::Emit(uint16_t hookId, EEventKind kind, uint8_t argCount, uint32_t a0, uint32_t a1,
+                 uint32_t a2, uint32_t a3)
+{
+    SRing *ring = tracer.GetRing();
+    if (ring == nullptr)
+        return;
+
+    uint32_t head = ring->Head;
+    if (head - ring->Tail >= RingEventCount)
+    {
+        ring->Dropped = ring->Dropped + 1;
+        return;
+    }
+
+    STraceEvent &ev = ring->Events[head & (RingEventCount - 1)];
+    ev.Ticks = __rdtsc();
+    ev.ThreadId = ring->ThreadId;
+    ev.HookId = hookId;
+    ev.Kind = kind;
+    ev.ArgCount = argCount;
+    ev.Args[0] = a0;
+    ev.Args[1] = a1;
+    ev.Args[2] = a2;
+    ev.Args[3] = a3;
+    COMPILER_BARRIER(); // Publish the event before moving the head
+    ring->Head = head + 1;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "Shared/TraceFormat.h"
+#include <cstdint>
+#include <string>
+
+//
+// Low overhead event tracer for hook callbacks.
+//
+// Every thread which emits events gets its own single-producer ring buffer,
+// so emitting an event takes no locks and does no allocation (except the
+// very first event of a thread). A background thread drains the rings into
+// a binary trace file (see TraceFormat.h). If a ring is full, the event is
+// dropped and counted instead of blocking the game.
+//
+// Hook targets of the plugin call Enter and Exit themselves, timing hooks call
+// them through SetTimingHookTracer.
+//
+
+namespace Trace {
+
+const size_t RingEventCount = 16384; // Per thread, must be a power of two
+
+bool Start(const std::wstring &filename);
+void Stop();
+
+// Sets a name which is written to the trace file for the specified hook id
+void SetHookName(uint16_t hookId, const char *name);
+
+// Total number of events dropped because of full rings
+uint64_t GetDroppedCount();
+
+void Emit(uint16_t hookId, EEventKind kind, uint8_t argCount, uint32_t a0, uint32_t a1,
+          uint32_t a2, uint32_t a3);
+
+extern volatile bool Enabled;
+
+static inline void Mark(uint16_t hookId)
+{
+    if (Enabled)
+        Emit(hookId, EK_MARK, 0, 0, 0, 0, 0);
+}
+
+static inline void Mark(uint16_t hookId, uint32_t a0)
+{
+    if (Enabled)
+        Emit(hookId, EK_MARK, 1, a0, 0, 0, 0);
+}
+
+static inline void Mark(uint16_t hookId, uint32_t a0, uint32_t a1)
+{
+    if (Enabled)
+        Emit(hookId, EK_MARK, 2, a0, a1, 0, 0);
+}
+
+static inline void Mark(uint16_t hookId, uint32_t a0, uint32_t a1, uint32_t a2)
+{
+    if (Enabled)
+        Emit(hookId, EK_MARK, 3, a0, a1, a2, 0);
+}
+
+static inline void Mark(uint16_t hookId, uint32_t a0, uint32_t a1, uint32_t a2, uint32_t a3)
+{
+    if (Enabled)
+        Emit(hookId, EK_MARK, 4, a0, a1, a2, a3);
+}
+
+static inline void Enter(uint16_t hookId, uint32_t a0 = 0, uint32_t a1 = 0)
+{
+    if (Enabled)
+        Emit(hookId, EK_ENTER, 2, a0, a1, 0, 0);
+}
+
+static inline void Exit(uint16_t hookId, uint32_t result = 0)
+{
+    if (Enabled)
+        Emit(hookId, EK_EXIT, 1, result, 0, 0, 0);
+}
+
+} // namespace Trace
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+//
+// Binary trace file layout:
+//
+//   STraceHeader
+//   STraceEvent[EventCount]
+//   STraceName[NameCount] (each one is followed by Length chars of the name)
+//
+// The header is written twice: with zero counters when the trace starts and
+// with final values when it is stopped. A trace of a crashed process has
+// zero EventCount, so readers should derive it from the file size instead.
+//
+
+namespace Trace {
+
+const uint32_t FileMagic = 0x43525448; // "HTRC"
+const uint16_t FileVersion = 1;
+const size_t MaxEventArgs = 4;
+
+enum EEventKind : uint8_t
+{
+    EK_MARK,    // Single point event
+    EK_ENTER,   // Hooked function entered
+    EK_EXIT,    // Hooked function returned
+    EK_DROPPED, // Args[0] events of the thread were lost because its ring was full
+};
+
+#pragma pack(push, 1)
+struct STraceHeader
+{
+    uint32_t Magic;
+    uint16_t Version;
+    uint16_t EventSize;
+    uint64_t TicksPerSecond;
+    uint64_t StartTicks;
+    uint64_t EventCount;
+    uint64_t DroppedCount;
+    uint64_t NamesOffset;
+    uint32_t NameCount;
+    uint32_t Reserved;
+};
+
+struct STraceEvent
+{
+    uint64_t Ticks;
+    uint32_t ThreadId;
+    uint16_t HookId;
+    EEventKind Kind;
+    uint8_t ArgCount;
+    uint32_t Args[MaxEventArgs];
+};
+
+struct STraceName
+{
+    uint16_t HookId;
+    uint16_t Length;
+};
+#pragma pack(pop)
+
+static_assert(sizeof(STraceHeader) == 56, "Unexpected trace header size");
+static_assert(sizeof(STraceEvent) == 32, "Unexpected trace event size");
+
+} // namespace Trace
@@ -9,6 +9,8 @@
 
 #ifdef _MSC_VER
 #include <intrin.h>
+#else
+#include <string.h>
 #endif
 
 #define C_NONE 0x00
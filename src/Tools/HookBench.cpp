@@ -0,0 +1,422 @@
+//
+// Per-call overhead of generated hook wrappers.
+//
+// Synthetic x86 functions are generated twice in an executable mapping, one
+// copy is hooked and the other one is the baseline. Both are called in tight
+// loops and the difference of TSC cycles per call is the cost of the hook.
+// Hook targets call the original functions through their trampolines, as
+// real hooks do. Results are printed as JSON.
+//
+// Usage: hookbench [output.json]
+//
+
+#include "Shared/Asm.h"
+#include "Shared/Common.h"
+#include "Shared/Hook.h"
+#include "Shared/Patcher.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <windows.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+using namespace Asm;
+using namespace Patcher;
+using namespace SimpleHooker86;
+
+static const size_t Iterations = 1000000;
+static const size_t Repeats = 7;
+static const size_t FunctionStride = 64;
+
+// thiscall is called as fastcall with a dummy edx, it's not available for free functions in MSVC
+typedef int(__stdcall *StdcallPtr)(int a, int b);
+typedef int(__cdecl *CdeclPtr)(int a, int b);
+typedef int(__fastcall *FastcallPtr)(int a, int b);
+typedef int(__fastcall *ThiscallPtr)(int self, int edx, int a);
+
+static StdcallPtr OrigStdcall;
+static CdeclPtr OrigCdecl;
+static StdcallPtr OrigFastcall; // Converted to stdcall
+static StdcallPtr OrigThiscall; // Converted to stdcall
+static CdeclPtr OrigThiscallVar;
+static StdcallPtr OrigVirtual;       // Converted to stdcall
+static StdcallPtr OrigShadowVirtual; // Converted to stdcall
+static int VirtualCalls;
+
+static int __stdcall StdcallTarget(int a, int b)
+{
+    return OrigStdcall(a, b);
+}
+
+static int __cdecl CdeclTarget(int a, int b)
+{
+    return OrigCdecl(a, b);
+}
+
+static int __stdcall FastcallTarget(int a, int b)
+{
+    return OrigFastcall(a, b);
+}
+
+static int __stdcall ThiscallTarget(int self, int a)
+{
+    return OrigThiscall(self, a);
+}
+
+static int __cdecl ThiscallVarTarget(int self, int a)
+{
+    return OrigThiscallVar(self, a);
+}
+
+static int __stdcall VirtualTarget(int self, int a)
+{
+    VirtualCalls++;
+    return OrigVirtual(self, a);
+}
+
+static int __stdcall ShadowVirtualTarget(int self, int a)
+{
+    VirtualCalls++;
+    return OrigShadowVirtual(self, a);
+}
+
+// The call is replaced, so there is no original function to call
+static int __stdcall CallTarget(int a, int b)
+{
+    return a + b;
+}
+
+static void __stdcall CodeHookCallback(void *, SCodeHookCtx *)
+{
+}
+
+static Stats::SAtomicHistogram TimingHistogram;
+
+class CCodeBuffer
+{
+public:
+    CCodeBuffer()
+        : _code(nullptr)
+        , _used(0)
+    {
+        _code = (uint8_t *)VirtualAlloc(NULL, Size, MEM_RESERVE | MEM_COMMIT,
+                                        PAGE_EXECUTE_READWRITE);
+        VERIFY(_code != nullptr);
+    }
+
+    // Returns the address of the emitted function
+    uint8_t *Emit(const CAssemblerBase &code)
+    {
+        VERIFY(_used + FunctionStride <= Size && code.GetSize() <= FunctionStride);
+        uint8_t *result = _code + _used;
+        VERIFY(code.Write(result) != 0);
+        _used += FunctionStride;
+        return result;
+    }
+
+private:
+    static const size_t Size = 64 * 1024;
+    uint8_t *_code;
+    size_t _used;
+};
+
+static CCodeBuffer Code;
+
+// a + b with arguments on the stack. Prologues are long enough to be moved to trampolines
+static uint8_t *CreateStackFunc(uint16_t argsSize)
+{
+    CAssembler<FunctionStride> a;
+    a.Push(RN_EBP).Mov(RN_EBP, RN_ESP);
+    a.Mov(RN_EAX, Mem(RN_EBP, 8)).Add(RN_EAX, Mem(RN_EBP, 12));
+    a.Pop(RN_EBP);
+    if (argsSize != 0)
+        a.Ret(argsSize);
+    else
+        a.Ret();
+    return Code.Emit(a);
+}
+
+static uint8_t *CreateFastcallFunc()
+{
+    CAssembler<FunctionStride> a;
+    a.Push(RN_EBP).Mov(RN_EBP, RN_ESP);
+    a.Mov(RN_EAX, RN_ECX).Add(RN_EAX, RN_EDX);
+    a.Pop(RN_EBP).Ret();
+    return Code.Emit(a);
+}
+
+static uint8_t *CreateThiscallFunc()
+{
+    CAssembler<FunctionStride> a;
+    a.Push(RN_EBP).Mov(RN_EBP, RN_ESP);
+    a.Mov(RN_EAX, Mem(RN_EBP, 8)).Add(RN_EAX, RN_ECX);
+    a.Pop(RN_EBP).Ret(4);
+    return Code.Emit(a);
+}
+
+// stdcall function which starts with 5 bytes which a code hook may drop
+static uint8_t *CreateCodeHookFunc()
+{
+    CAssembler<FunctionStride> a;
+    a.Nops(CallJmpSize);
+    a.Mov(RN_EAX, Mem(RN_ESP, 4)).Add(RN_EAX, Mem(RN_ESP, 8));
+    a.Ret(8);
+    return Code.Emit(a);
+}
+
+// stdcall function which calls callee, callInstr receives the address of the call
+static uint8_t *CreateCallerFunc(const void *callee, uint8_t **callInstr)
+{
+    CAssembler<FunctionStride> a;
+    a.Push(RN_EBP).Mov(RN_EBP, RN_ESP);
+    a.Push(Mem(RN_EBP, 12)).Push(Mem(RN_EBP, 8));
+    size_t callOffset = a.GetSize();
+    a.Call(callee);
+    a.Pop(RN_EBP).Ret(8);
+    uint8_t *result = Code.Emit(a);
+    *callInstr = result + callOffset;
+    return result;
+}
+
+// Returns the best of TSC cycles per call
+template <class Call>
+static double Measure(Call call)
+{
+    double best = 1e30;
+    volatile int sink = 0;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        int sum = 0;
+        uint64_t start = __rdtsc();
+        for (size_t i = 0; i < Iterations; i++)
+            sum += call((int)i);
+        uint64_t ticks = __rdtsc() - start;
+        sink = sink + sum;
+        best = std::min(best, (double)ticks / Iterations);
+    }
+    return best;
+}
+
+struct SResult
+{
+    std::string Name;
+    double Baseline;
+    double Hooked;
+};
+
+static std::vector<SResult> Results;
+
+template <class BaseCall, class HookedCall>
+static void AddResult(const char *name, BaseCall baseline, HookedCall hooked)
+{
+    SResult result = {name, Measure(baseline), Measure(hooked)};
+    Results.push_back(result);
+    fprintf(stderr, "%-20s %8.1f %8.1f %+8.1f cycles\n", name, result.Baseline, result.Hooked,
+            result.Hooked - result.Baseline);
+}
+
+// Function pointers are passed through volatile variables, so calls can't be inlined
+template <class Func>
+struct SCaller
+{
+    Func volatile Ptr;
+};
+
+static void BenchFuncHooks(SPatch &patch)
+{
+    static SCaller<StdcallPtr> stdBase, stdHook;
+    stdBase.Ptr = (StdcallPtr)CreateStackFunc(8);
+    stdHook.Ptr = (StdcallPtr)CreateStackFunc(8);
+    VERIFY(CreateFuncHook((void *)stdHook.Ptr, 8, CC_STDCALL, (void *)StdcallTarget,
+                          (void **)&OrigStdcall, patch));
+
+    static SCaller<CdeclPtr> cdeclBase, cdeclHook;
+    cdeclBase.Ptr = (CdeclPtr)CreateStackFunc(0);
+    cdeclHook.Ptr = (CdeclPtr)CreateStackFunc(0);
+    VERIFY(CreateFuncHook((void *)cdeclHook.Ptr, 8, CC_CDECL, (void *)CdeclTarget,
+                          (void **)&OrigCdecl, patch));
+
+    static SCaller<FastcallPtr> fastBase, fastHook;
+    fastBase.Ptr = (FastcallPtr)CreateFastcallFunc();
+    fastHook.Ptr = (FastcallPtr)CreateFastcallFunc();
+    VERIFY(CreateFuncHook((void *)fastHook.Ptr, 0, CC_FASTCALL, (void *)FastcallTarget,
+                          (void **)&OrigFastcall, patch));
+
+    static SCaller<ThiscallPtr> thisBase, thisHook;
+    thisBase.Ptr = (ThiscallPtr)CreateThiscallFunc();
+    thisHook.Ptr = (ThiscallPtr)CreateThiscallFunc();
+    VERIFY(CreateFuncHook((void *)thisHook.Ptr, 4, CC_THISCALL, (void *)ThiscallTarget,
+                          (void **)&OrigThiscall, patch));
+
+    static SCaller<CdeclPtr> varBase, varHook;
+    varBase.Ptr = (CdeclPtr)CreateStackFunc(0);
+    varHook.Ptr = (CdeclPtr)CreateStackFunc(0);
+    VERIFY(CreateFuncHook((void *)varHook.Ptr, 8, CC_THISCALL_VAR, (void *)ThiscallVarTarget,
+                          (void **)&OrigThiscallVar, patch));
+
+    ApplyPatch(patch);
+    patch.Chunks.clear();
+
+    // Hooked functions must still compute the same
+    VERIFY(stdHook.Ptr(2, 3) == 5 && cdeclHook.Ptr(2, 3) == 5 && fastHook.Ptr(2, 3) == 5 &&
+           thisHook.Ptr(2, 0, 3) == 5 && varHook.Ptr(2, 3) == 5);
+
+    AddResult("func_stdcall", [](int i) { return stdBase.Ptr(i, 1); },
+              [](int i) { return stdHook.Ptr(i, 1); });
+    AddResult("func_cdecl", [](int i) { return cdeclBase.Ptr(i, 1); },
+              [](int i) { return cdeclHook.Ptr(i, 1); });
+    AddResult("func_fastcall", [](int i) { return fastBase.Ptr(i, 1); },
+              [](int i) { return fastHook.Ptr(i, 1); });
+    AddResult("func_thiscall", [](int i) { return thisBase.Ptr(i, 0, 1); },
+              [](int i) { return thisHook.Ptr(i, 0, 1); });
+    AddResult("func_thiscall_var", [](int i) { return varBase.Ptr(i, 1); },
+              [](int i) { return varHook.Ptr(i, 1); });
+}
+
+static void BenchFuncCallHook(SPatch &patch)
+{
+    static SCaller<StdcallPtr> base, hook;
+    uint8_t *callInstr;
+    uint8_t *callee = CreateStackFunc(8);
+    base.Ptr = (StdcallPtr)CreateCallerFunc(callee, &callInstr);
+    hook.Ptr = (StdcallPtr)CreateCallerFunc(callee, &callInstr);
+    VERIFY(CreateFuncCallHook(callInstr, 8, CC_STDCALL, (void *)CallTarget, patch));
+
+    ApplyPatch(patch);
+    patch.Chunks.clear();
+    VERIFY(hook.Ptr(2, 3) == 5);
+
+    AddResult("func_call", [](int i) { return base.Ptr(i, 1); },
+              [](int i) { return hook.Ptr(i, 1); });
+}
+
+static void BenchCodeHooks(SPatch &patch)
+{
+    static const char *const names[] = {"code_ignore", "code_before", "code_after"};
+    static const EOrigCodePosition positions[] = {OCP_IGNORE, OCP_BEFORE, OCP_AFTER};
+    static SCaller<StdcallPtr> base, hooks[_countof(positions)];
+
+    base.Ptr = (StdcallPtr)CreateCodeHookFunc();
+    for (size_t i = 0; i < _countof(positions); i++)
+    {
+        hooks[i].Ptr = (StdcallPtr)CreateCodeHookFunc();
+        VERIFY(CreateCodeHook((void *)hooks[i].Ptr, positions[i], CodeHookCallback, nullptr,
+                              patch));
+    }
+
+    ApplyPatch(patch);
+    patch.Chunks.clear();
+
+    static size_t current;
+    for (current = 0; current < _countof(positions); current++)
+    {
+        VERIFY(hooks[current].Ptr(2, 3) == 5);
+        AddResult(names[current], [](int i) { return base.Ptr(i, 1); },
+                  [](int i) { return hooks[current].Ptr(i, 1); });
+    }
+}
+
+static void BenchTimingHook(SPatch &patch)
+{
+    static SCaller<StdcallPtr> base, hook;
+    base.Ptr = (StdcallPtr)CreateStackFunc(8);
+    hook.Ptr = (StdcallPtr)CreateStackFunc(8);
+    VERIFY(CreateTimingHook((void *)hook.Ptr, &TimingHistogram, 0, patch));
+
+    ApplyPatch(patch);
+    patch.Chunks.clear();
+    VERIFY(hook.Ptr(2, 3) == 5);
+
+    AddResult("timing", [](int i) { return base.Ptr(i, 1); },
+              [](int i) { return hook.Ptr(i, 1); });
+}
+
+// An object with one virtual thiscall function
+struct SObject
+{
+    void **Vtable;
+};
+
+static int CallVirtual(SObject *object, int a)
+{
+    return ((ThiscallPtr)object->Vtable[0])((int)object, 0, a);
+}
+
+static void BenchVtableHooks(SPatch &patch)
+{
+    // The RTTI pointer and the slot
+    static void *vtable[2], *hookedVtable[2];
+    vtable[1] = CreateThiscallFunc();
+    hookedVtable[1] = CreateThiscallFunc();
+    static SObject base = {vtable + 1}, hooked = {hookedVtable + 1}, shadowed = {vtable + 1};
+    VERIFY(CreateVtableHook(hooked.Vtable, 0, 4, CC_THISCALL, (void *)VirtualTarget,
+                            (void **)&OrigVirtual, patch));
+
+    // Only the object with the copy of the vtable is hooked
+    void **shadow = CreateShadowVtable(&shadowed, 1);
+    VERIFY(shadow != nullptr && shadow[-1] == vtable[0]);
+    VERIFY(CreateVtableHook(shadow, 0, 4, CC_THISCALL, (void *)ShadowVirtualTarget,
+                            (void **)&OrigShadowVirtual, patch));
+
+    ApplyPatch(patch);
+    patch.Chunks.clear();
+    VERIFY(SwapVtable(&shadowed, shadow) == vtable + 1);
+
+    VERIFY(CallVirtual(&base, 3) == (int)&base + 3 && VirtualCalls == 0);
+    VERIFY(CallVirtual(&hooked, 3) == (int)&hooked + 3 && VirtualCalls == 1);
+    VERIFY(CallVirtual(&shadowed, 3) == (int)&shadowed + 3 && VirtualCalls == 2);
+
+    AddResult("vtable_thiscall", [](int i) { return CallVirtual(&base, i); },
+              [](int i) { return CallVirtual(&hooked, i); });
+    AddResult("vtable_shadow", [](int i) { return CallVirtual(&base, i); },
+              [](int i) { return CallVirtual(&shadowed, i); });
+}
+
+static bool WriteJson(FILE *file)
+{
+    fprintf(file, "{\n  \"iterations\": %u,\n  \"hooks\": [\n", (unsigned)Iterations);
+    for (size_t i = 0; i < Results.size(); i++)
+    {
+        const SResult &r = Results[i];
+        fprintf(file,
+                "    {\"name\": \"%s\", \"baseline_cycles\": %.2f, \"hooked_cycles\": %.2f, "
+                "\"overhead_cycles\": %.2f}%s\n",
+                r.Name.c_str(), r.Baseline, r.Hooked, r.Hooked - r.Baseline,
+                i + 1 < Results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return !ferror(file);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "Usage: hookbench [output.json]\n");
+        return 1;
+    }
+
+    fprintf(stderr, "%-20s %8s %8s %8s\n", "Hook", "Base", "Hooked", "Overhead");
+    SPatch patch;
+    BenchFuncHooks(patch);
+    BenchFuncCallHook(patch);
+    BenchCodeHooks(patch);
+    BenchTimingHook(patch);
+    BenchVtableHooks(patch);
+
+    FILE *file = argc > 1 ? fopen(argv[1], "w") : stdout;
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot create %s\n", argv[1]);
+        return 1;
+    }
+    bool result = WriteJson(file);
+    if (file != stdout)
+        result = fclose(file) == 0 && result;
+    return result ? 0 : 1;
+}
@@ -0,0 +1,228 @@
+//
+// Host benchmark of the INI parser used for plugin.ini.
+//
+// A file with 1000 keys is generated, loaded and every key is looked up, as
+// the plugin does on startup. On Windows the same keys are also read with
+// GetPrivateProfileStringA, which the parser replaces, and the values are
+// compared. Results are printed as JSON.
+//
+// Usage: inibench [output.json]
+//
+
+#include "Shared/Ini.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+static const size_t SectionCount = 50;
+static const size_t KeysPerSection = 20;
+static const size_t KeyCount = SectionCount * KeysPerSection;
+static const size_t Repeats = 5;
+static const char *const IniFilename = "inibench.ini";
+
+struct SResult
+{
+    std::string Name;
+    const char *Unit;
+    uint64_t Count;
+    double Seconds;
+};
+
+static std::vector<SResult> Results;
+
+static double Now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, freq;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&freq);
+    return (double)counter.QuadPart / freq.QuadPart;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static void AddResult(const std::string &name, const char *unit, uint64_t count, double seconds)
+{
+    SResult result = {name, unit, count, seconds};
+    Results.push_back(result);
+    fprintf(stderr, "%-32s %12.0f %s/s\n", name.c_str(), seconds > 0 ? count / seconds : 0.0,
+            unit);
+}
+
+static std::string GetSection(size_t i)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "Section%u", (unsigned)i);
+    return buf;
+}
+
+static std::string GetKey(size_t i)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "Key%u", (unsigned)i);
+    return buf;
+}
+
+static std::string GetValue(size_t section, size_t key)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "0x%X", (unsigned)(0x400000 + section * 0x1000 + key * 0x10));
+    return buf;
+}
+
+// Sections and keys are written in a mixed case with comments and spaces, as people write them
+static bool WriteIniFile()
+{
+    FILE *file = fopen(IniFilename, "w");
+    if (file == nullptr)
+        return false;
+    for (size_t i = 0; i < SectionCount; i++)
+    {
+        fprintf(file, "; Comment of section %u\n[%s]\n", (unsigned)i, GetSection(i).c_str());
+        for (size_t j = 0; j < KeysPerSection; j++)
+        {
+            fprintf(file, j % 2 ? "%s = %s\n" : "%s=\"%s\"\n", GetKey(j).c_str(),
+                    GetValue(i, j).c_str());
+        }
+        fprintf(file, "\n");
+    }
+    return fclose(file) == 0;
+}
+
+static void BenchIniFile()
+{
+    // Names are prepared in advance and looked up in lowercase, so a case insensitive match is
+    // needed
+    std::vector<std::string> sections, keys, values;
+    for (size_t i = 0; i < SectionCount; i++)
+    {
+        std::string section = GetSection(i);
+        std::transform(section.begin(), section.end(), section.begin(), ::tolower);
+        sections.push_back(section);
+        for (size_t j = 0; j < KeysPerSection; j++)
+            values.push_back(GetValue(i, j));
+    }
+    for (size_t i = 0; i < KeysPerSection; i++)
+        keys.push_back(GetKey(i));
+
+    Ini::CIniFile ini;
+    double bestLoad = 1e9;
+    double bestLookup = 1e9;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        double start = Now();
+        if (!ini.Load(IniFilename) || ini.GetKeyCount() != KeyCount)
+        {
+            fprintf(stderr, "Cannot load %s\n", IniFilename);
+            exit(1);
+        }
+        double loaded = Now();
+
+        size_t found = 0;
+        for (size_t i = 0; i < SectionCount; i++)
+        {
+            for (size_t j = 0; j < KeysPerSection; j++)
+            {
+                found += ini.GetString(sections[i].c_str(), keys[j].c_str(), "") ==
+                         values[i * KeysPerSection + j];
+            }
+        }
+        if (found != KeyCount)
+        {
+            fprintf(stderr, "Only %u of %u keys have expected values\n", (unsigned)found,
+                    (unsigned)KeyCount);
+            exit(1);
+        }
+
+        double end = Now();
+        bestLoad = std::min(bestLoad, loaded - start);
+        bestLookup = std::min(bestLookup, end - loaded);
+    }
+    AddResult("ini_load", "keys", KeyCount, bestLoad);
+    AddResult("ini_lookup", "keys", KeyCount, bestLookup);
+    AddResult("ini_load_and_lookup", "keys", KeyCount, bestLoad + bestLookup);
+
+#ifdef _WIN32
+    // GetPrivateProfileStringA needs a full path, otherwise it looks in the Windows directory
+    char path[MAX_PATH];
+    GetFullPathNameA(IniFilename, sizeof(path), path, nullptr);
+    double best = 1e9;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        double start = Now();
+        for (size_t i = 0; i < SectionCount; i++)
+        {
+            for (size_t j = 0; j < KeysPerSection; j++)
+            {
+                char buf[64];
+                GetPrivateProfileStringA(sections[i].c_str(), keys[j].c_str(), "", buf,
+                                         sizeof(buf), path);
+                if (ini.GetString(sections[i].c_str(), keys[j].c_str(), "") != buf)
+                {
+                    fprintf(stderr, "Values of %s.%s differ\n", sections[i].c_str(),
+                            keys[j].c_str());
+                    exit(1);
+                }
+            }
+        }
+        best = std::min(best, Now() - start);
+    }
+    AddResult("get_private_profile_string", "keys", KeyCount, best);
+#endif
+}
+
+static bool WriteJson(FILE *file)
+{
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < Results.size(); i++)
+    {
+        const SResult &r = Results[i];
+        fprintf(file,
+                "    {\"name\": \"%s\", \"unit\": \"%s\", \"count\": %llu, \"seconds\": %.9f, "
+                "\"per_second\": %.1f}%s\n",
+                r.Name.c_str(), r.Unit, (unsigned long long)r.Count, r.Seconds,
+                r.Seconds > 0 ? r.Count / r.Seconds : 0.0, i + 1 < Results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return !ferror(file);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "Usage: inibench [output.json]\n");
+        return 1;
+    }
+
+    if (!WriteIniFile())
+    {
+        fprintf(stderr, "Cannot create %s\n", IniFilename);
+        return 1;
+    }
+    BenchIniFile();
+    remove(IniFilename);
+
+    FILE *file = argc > 1 ? fopen(argv[1], "w") : stdout;
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot create %s\n", argv[1]);
+        return 1;
+    }
+    bool result = WriteJson(file);
+    if (file != stdout)
+        result = fclose(file) == 0 && result;
+    return result ? 0 : 1;
+}
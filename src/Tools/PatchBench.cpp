@@ -0,0 +1,410 @@
+//
+// Host benchmarks of Patcher, Hook, hde32, CRC32, memory compare and patch
+// images.
+//
+// Hooks are installed into synthetic functions in a buffer of this process,
+// they are never called. Results are printed as JSON, one object per
+// benchmark, so they can be compared across builds.
+//
+// Usage: patchbench [output.json]
+//
+
+#include "Shared/Asm.h"
+#include "Shared/Common.h"
+#include "Shared/Hook.h"
+#include "Shared/PatchImage.h"
+#include "Shared/Patcher.h"
+#include "Shared/hde/hde32.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <windows.h>
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+using namespace Patcher;
+using namespace SimpleHooker86;
+
+static const size_t ImageSize = 0x33A000; // Size of the game's .text
+static const size_t FunctionStride = 32;
+static const size_t Repeats = 5;
+
+struct SResult
+{
+    std::string Name;
+    const char *Unit;
+    uint64_t Count;
+    double Seconds;
+};
+
+static std::vector<SResult> Results;
+
+static double Now()
+{
+#ifdef _WIN32
+    LARGE_INTEGER counter, freq;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&freq);
+    return (double)counter.QuadPart / freq.QuadPart;
+#else
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+#endif
+}
+
+static uint32_t NextRandom(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+static void AddResult(const std::string &name, const char *unit, uint64_t count, double seconds)
+{
+    SResult result = {name, unit, count, seconds};
+    Results.push_back(result);
+    fprintf(stderr, "%-32s %12.0f %s/s\n", name.c_str(), seconds > 0 ? count / seconds : 0.0,
+            unit);
+}
+
+static void BenchPatchBuild()
+{
+    const size_t writeCount = 100000;
+    const size_t scatteredCount = 10000;
+    uint8_t *base = (uint8_t *)0x401000;
+
+    // Every write continues the previous one, so all of them go to one chunk
+    double best = 1e9;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        double start = Now();
+        SPatch patch;
+        patch.SetAddr(base);
+        for (size_t i = 0; i < writeCount; i++)
+            patch.WriteU32((uint32_t)i);
+        patch.Finish();
+        best = std::min(best, Now() - start);
+    }
+    AddResult("spatch_build_sequential", "writes", writeCount, best);
+
+    // Every write starts a new chunk which is checked for merging with all previous ones
+    best = 1e9;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        uint32_t state = 2463534242u;
+        double start = Now();
+        SPatch patch;
+        for (size_t i = 0; i < scatteredCount; i++)
+            patch.WriteU32(base + NextRandom(state) % ImageSize, (uint32_t)i);
+        patch.Finish();
+        best = std::min(best, Now() - start);
+    }
+    AddResult("spatch_build_scattered", "writes", scatteredCount, best);
+}
+
+static void BenchApplyPatches()
+{
+    const size_t patchCount = 200;
+    auto image = (uint8_t *)VirtualAlloc(NULL, ImageSize, MEM_RESERVE | MEM_COMMIT,
+                                         PAGE_EXECUTE_READ);
+    VERIFY(image != nullptr);
+
+    // A mix of byte writes, jumps and replaced blocks, as real patches do
+    std::vector<SPatch> patches(patchCount);
+    uint32_t state = 88172645u;
+    uint64_t bytes = 0;
+    for (size_t i = 0; i < patchCount; i++)
+    {
+        for (size_t j = 0; j < 8; j++)
+        {
+            uint8_t *addr = image + NextRandom(state) % (ImageSize - 4096);
+            switch (j % 4)
+            {
+            case 0:
+                patches[i].WriteByte(addr, 0xEB);
+                break;
+            case 1:
+                patches[i].WriteJump(addr, image);
+                break;
+            case 2:
+                patches[i].WritePush(addr, 0x12345678);
+                break;
+            case 3:
+                patches[i].WriteNops(addr, NextRandom(state) % 4096);
+                break;
+            }
+        }
+        patches[i].Finish();
+        for (size_t j = 0; j < patches[i].Chunks.size(); j++)
+            bytes += patches[i].Chunks[j].Data.size();
+    }
+
+    double best = 1e9;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        double start = Now();
+        DWORD oldProtect;
+        VERIFY(VirtualProtect(image, ImageSize, PAGE_EXECUTE_READWRITE, &oldProtect));
+        for (size_t i = 0; i < patchCount; i++)
+            ApplyPatch(patches[i]);
+        VERIFY(VirtualProtect(image, ImageSize, PAGE_EXECUTE_READ, &oldProtect));
+        FlushInstructionCache(GetCurrentProcess(), image, ImageSize);
+        best = std::min(best, Now() - start);
+    }
+    AddResult("apply_patches", "bytes", bytes, best);
+}
+
+static void BenchPatchImage()
+{
+    const size_t runCount = 100000;
+    const uint32_t base = 0x401000;
+
+    // Runs of 4 bytes with gaps between them, every one is a separate chunk
+    PatchImage::CImageBuilder builder;
+    uint8_t newBytes[4] = {0x90, 0x90, 0x90, 0x90}, oldBytes[4] = {0xCC, 0xCC, 0xCC, 0xCC};
+    builder.BeginPatch("Bench");
+    for (size_t i = 0; i < runCount; i++)
+        builder.AddWrite(base + (uint32_t)i * 8, newBytes, oldBytes, sizeof(newBytes));
+    PatchImage::SImageStamp stamp = {0, 0, 0};
+    std::vector<uint8_t> file;
+    builder.Write(stamp, file);
+
+    // Page aligned as a mapped file is
+    auto view = (uint8_t *)VirtualAlloc(NULL, file.size(), MEM_RESERVE | MEM_COMMIT,
+                                        PAGE_READWRITE);
+    VERIFY(view != nullptr);
+    memcpy(view, &file[0], file.size());
+
+    double best = 1e9;
+    std::vector<SChunkRef> refs;
+    refs.reserve(runCount);
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        refs.clear();
+        double start = Now();
+        PatchImage::CPatchImage image;
+        VERIFY(image.Parse(view, file.size()));
+        for (size_t i = 0; i < image.GetPatchCount(); i++)
+        {
+            for (size_t j = 0; j < image.GetRunCount(i); j++)
+            {
+                auto run = image.GetRun(i, j);
+                SChunkRef ref = {(uint8_t *)(uintptr_t)run.Addr, run.NewBytes, run.Size};
+                refs.push_back(ref);
+            }
+        }
+        best = std::min(best, Now() - start);
+    }
+    VERIFY(refs.size() == runCount);
+    AddResult("patch_image_load", "runs", runCount, best);
+
+    best = 1e9;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        PatchImage::CPatchImage image;
+        VERIFY(image.Parse(view, file.size()));
+        double start = Now();
+        VERIFY(image.VerifyCrc());
+        best = std::min(best, Now() - start);
+    }
+    AddResult("patch_image_crc", "bytes", file.size(), best);
+    VirtualFree(view, 0, MEM_RELEASE);
+}
+
+static void __stdcall DummyTarget(uint32_t, uint32_t)
+{
+}
+
+static void __stdcall DummyCallback(void *, SCodeHookCtx *)
+{
+}
+
+// Functions with a typical prologue which is long enough to be moved to a trampoline
+static uint8_t *CreateFunctions(size_t count)
+{
+    size_t size = count * FunctionStride;
+    auto code = (uint8_t *)VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    VERIFY(code != nullptr);
+    for (size_t i = 0; i < count; i++)
+    {
+        Asm::CAssembler<FunctionStride> a;
+        a.Push(RN_EBP).Mov(RN_EBP, RN_ESP).Sub(RN_ESP, 0x40).Push(RN_EBX).Push(RN_ESI);
+        a.Pop(RN_ESI).Pop(RN_EBX).Leave().Ret(8);
+        a.Nops(FunctionStride - a.GetSize());
+        a.Write(code + i * FunctionStride);
+    }
+    return code;
+}
+
+static void BenchHookInstall()
+{
+    const size_t counts[] = {1, 100, 1000};
+    size_t total = 0;
+    for (size_t i = 0; i < _countof(counts); i++)
+        total += counts[i] * 2;
+    uint8_t *code = CreateFunctions(total);
+
+    // Hooks can't be removed, so every run uses its own functions
+    for (size_t i = 0; i < _countof(counts); i++)
+    {
+        size_t count = counts[i];
+        char name[64];
+
+        SPatch patch;
+        double start = Now();
+        for (size_t j = 0; j < count; j++)
+        {
+            void *orig;
+            VERIFY(CreateFuncHook(code, 8, CC_STDCALL, (void *)DummyTarget, &orig, patch));
+            code += FunctionStride;
+        }
+        snprintf(name, sizeof(name), "create_func_hook_%u", (unsigned)count);
+        AddResult(name, "hooks", count, Now() - start);
+
+        start = Now();
+        for (size_t j = 0; j < count; j++)
+        {
+            VERIFY(CreateCodeHook(code, OCP_BEFORE, DummyCallback, nullptr, patch));
+            code += FunctionStride;
+        }
+        snprintf(name, sizeof(name), "create_code_hook_%u", (unsigned)count);
+        AddResult(name, "hooks", count, Now() - start);
+    }
+}
+
+static void BenchDisasm()
+{
+    const size_t codeSize = 1024 * 1024;
+    std::vector<uint8_t> code(codeSize + 64);
+    size_t used = 0;
+
+    // A mix of instructions seen in function prologues moved by hooks
+    while (used < codeSize)
+    {
+        Asm::CAssembler<64> a;
+        a.Push(RN_EBP).Mov(RN_EBP, RN_ESP).Sub(RN_ESP, 0x1000).Push(RN_EBX);
+        a.Mov(RN_EAX, Asm::Mem(RN_EBP, 8)).Mov(Asm::Mem(RN_ESP, 4), RN_ECX);
+        a.Lea(RN_EDX, Asm::Mem(RN_EAX, 0x100)).Cmp(RN_EAX, 0).Push(0x12345678u);
+        a.Call(RN_EAX).Test(RN_EAX, RN_EAX).Leave().Ret(4);
+        used += a.Write(&code[used]);
+    }
+
+    double best = 1e9;
+    uint64_t count = 0;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        count = 0;
+        double start = Now();
+        for (size_t offset = 0; offset < used; count++)
+        {
+            hde32s hs;
+            size_t len = hde32_disasm(&code[offset], &hs);
+            VERIFY(len != 0 && !(hs.flags & HDE_F_ERROR));
+            offset += len;
+        }
+        best = std::min(best, Now() - start);
+    }
+    AddResult("hde32_disasm", "instructions", count, best);
+}
+
+static void BenchCrc32()
+{
+    const size_t size = 64 * 1024 * 1024;
+    std::vector<uint8_t> data(size);
+    uint32_t state = 362436069u;
+    for (size_t i = 0; i < size; i += 4)
+    {
+        uint32_t value = NextRandom(state);
+        memcpy(&data[i], &value, sizeof(value));
+    }
+
+    double best = 1e9;
+    uint32_t crc = 0;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        double start = Now();
+        crc ^= Common::GetCrc32(&data[0], size);
+        best = std::min(best, Now() - start);
+    }
+    VERIFY(crc != 0x12345678); // Keep the result used
+    AddResult("crc32", "bytes", size, best);
+}
+
+// Compares as ApplyPatches does before writing, most of the bytes are already the same
+static void BenchFindMismatch()
+{
+    std::vector<uint8_t> a(ImageSize), b(ImageSize);
+    uint32_t state = 521288629u;
+    for (size_t i = 0; i < ImageSize; i += 4)
+    {
+        uint32_t value = NextRandom(state);
+        memcpy(&a[i], &value, sizeof(value));
+    }
+    b = a;
+    for (size_t i = 0; i < 100; i++)
+        b[NextRandom(state) % ImageSize] ^= 0xFF;
+
+    double best = 1e9;
+    size_t runs = 0;
+    for (size_t r = 0; r < Repeats; r++)
+    {
+        runs = 0;
+        double start = Now();
+        for (size_t offset = 0; offset < ImageSize; runs++)
+        {
+            offset += Common::FindMismatch(&a[offset], &b[offset], ImageSize - offset);
+            offset += Common::FindMatch(&a[offset], &b[offset], ImageSize - offset);
+        }
+        best = std::min(best, Now() - start);
+    }
+    VERIFY(runs != 0);
+    AddResult("find_mismatch", "bytes", ImageSize, best);
+}
+
+static bool WriteJson(FILE *file)
+{
+    fprintf(file, "{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < Results.size(); i++)
+    {
+        const SResult &r = Results[i];
+        fprintf(file,
+                "    {\"name\": \"%s\", \"unit\": \"%s\", \"count\": %llu, \"seconds\": %.9f, "
+                "\"per_second\": %.1f}%s\n",
+                r.Name.c_str(), r.Unit, (unsigned long long)r.Count, r.Seconds,
+                r.Seconds > 0 ? r.Count / r.Seconds : 0.0, i + 1 < Results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return !ferror(file);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 2)
+    {
+        fprintf(stderr, "Usage: patchbench [output.json]\n");
+        return 1;
+    }
+
+    BenchPatchBuild();
+    BenchApplyPatches();
+    BenchPatchImage();
+    BenchHookInstall();
+    BenchDisasm();
+    BenchCrc32();
+    BenchFindMismatch();
+
+    FILE *file = argc > 1 ? fopen(argv[1], "w") : stdout;
+    if (file == nullptr)
+    {
+        fprintf(stderr, "Cannot create %s\n", argv[1]);
+        return 1;
+    }
+    bool result = WriteJson(file);
+    if (file != stdout)
+        result = fclose(file) == 0 && result;
+    return result ? 0 : 1;
+}
@@ -0,0 +1,215 @@
+//
+// Offline compiler of static patches into a patch image.
+//
+// The game executable is loaded into a copy of its image as the loader would
+// map its sections, the config is read and every enabled static patch is
+// built. Bytes under the patches are taken from the copy as the expected
+// original ones. The plugin takes the patches from the image when it's set in
+// [Patches] Image, instead of building them at every launch.
+//
+// Usage: patchc <game.exe> <plugin.ini> <output>
+//
+
+#include "Plugin/config.h"
+#include "Plugin/gameversion.h"
+#include "Plugin/patches.h"
+#include "Shared/PatchImage.h"
+#include "Shared/PeImage.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// patches.cpp with the plugin runtime isn't linked, static patches only need the list
+SPatchDesc *SPatchDesc::First = nullptr;
+SPluginConfig PluginConfig;
+
+struct SExeImage
+{
+    uint32_t ImageBase;
+    uint32_t TimeStamp;
+    std::vector<uint8_t> Memory; // SizeOfImage bytes
+    PeImage::CPeImage Image;     // Of Memory
+};
+
+static bool ReadFile(const char *filename, std::vector<uint8_t> &result)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = false;
+    long size;
+    if (fseek(file, 0, SEEK_END) != 0)
+        goto fail;
+    size = ftell(file);
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0)
+        goto fail;
+    result.resize((size_t)size);
+    ok = size == 0 || fread(&result[0], 1, result.size(), file) == result.size();
+
+fail:
+    fclose(file);
+    return ok;
+}
+
+// Copies headers and sections to their virtual addresses
+static bool LoadExe(const std::vector<uint8_t> &file, SExeImage &exe)
+{
+    PeImage::CPeImage pe;
+    if (file.empty() || !pe.Parse(&file[0], file.size(), false))
+        return false;
+
+    exe.TimeStamp = pe.GetTimeStamp();
+    exe.ImageBase = pe.GetImageBase();
+    uint32_t imageSize = pe.GetImageSize();
+    uint32_t headersSize = pe.GetHeadersSize();
+    if (imageSize == 0 || headersSize > file.size() || headersSize > imageSize)
+        return false;
+
+    exe.Memory.assign(imageSize, 0);
+    memcpy(&exe.Memory[0], &file[0], headersSize);
+
+    const auto &sections = pe.GetSections();
+    for (auto it = sections.cbegin(); it != sections.cend(); ++it)
+    {
+        uint32_t rawSize = std::min(it->RawSize, it->Size);
+        if (it->RawOffset > file.size() || rawSize > file.size() - it->RawOffset ||
+            it->Rva > imageSize || rawSize > imageSize - it->Rva)
+        {
+            return false;
+        }
+        if (rawSize != 0)
+            memcpy(&exe.Memory[it->Rva], &file[it->RawOffset], rawSize);
+    }
+    return exe.Image.Parse(&exe.Memory[0], exe.Memory.size(), true);
+}
+
+// Returns nullptr if the chunk isn't inside the image
+static const uint8_t *GetExeBytes(const SExeImage &exe, const Patcher::SPatchChunk &chunk)
+{
+    uint32_t addr = (uint32_t)(uintptr_t)chunk.Addr;
+    uint32_t rva = addr - exe.ImageBase;
+    if (addr < exe.ImageBase || rva > exe.Memory.size() ||
+        chunk.Data.size() > exe.Memory.size() - rva)
+    {
+        return nullptr;
+    }
+    return &exe.Memory[rva];
+}
+
+// Static patches which don't depend on other patches are built in the order of names, as the
+// plugin does
+static bool BuildPatches(const SExeImage &exe, PatchImage::CImageBuilder &builder)
+{
+    std::vector<SPatchDesc *> descs;
+    for (SPatchDesc *desc = SPatchDesc::First; desc != nullptr; desc = desc->Next)
+        descs.push_back(desc);
+    std::sort(descs.begin(), descs.end(), [](const SPatchDesc *a, const SPatchDesc *b) {
+        return strcmp(a->Name, b->Name) < 0;
+    });
+
+    for (size_t i = 0; i < descs.size(); i++)
+    {
+        const SPatchDesc &desc = *descs[i];
+        if (!desc.Static || !desc.Dependencies.empty())
+        {
+            fprintf(stderr, "%s: built by the plugin\n", desc.Name);
+            continue;
+        }
+        if (GameVersion == nullptr && !desc.Ranges.empty())
+        {
+            fprintf(stderr, "%s: the game build isn't supported\n", desc.Name);
+            continue;
+        }
+
+        Patcher::SPatch patch(desc.Name);
+        if (!desc.Enabled(PluginConfig) || !desc.Apply(patch))
+        {
+            fprintf(stderr, "%s: disabled\n", desc.Name);
+            continue;
+        }
+
+        for (auto it = patch.Expected.cbegin(); it != patch.Expected.cend(); ++it)
+        {
+            const uint8_t *bytes = GetExeBytes(exe, *it);
+            if (it->Data.empty())
+                continue;
+            if (bytes == nullptr || memcmp(bytes, &it->Data[0], it->Data.size()) != 0)
+            {
+                fprintf(stderr, "%s: the exe differs from the expected bytes at 0x%X\n", desc.Name,
+                        (unsigned)(uintptr_t)it->Addr);
+                return false;
+            }
+        }
+
+        builder.BeginPatch(desc.Name);
+        for (auto it = patch.Chunks.cbegin(); it != patch.Chunks.cend(); ++it)
+        {
+            const uint8_t *bytes = GetExeBytes(exe, *it);
+            if (it->Data.empty())
+                continue;
+            if (bytes == nullptr)
+            {
+                fprintf(stderr, "%s: address 0x%X is outside of the image\n", desc.Name,
+                        (unsigned)(uintptr_t)it->Addr);
+                return false;
+            }
+            builder.AddWrite((uint32_t)(uintptr_t)it->Addr, &it->Data[0], bytes, it->Data.size());
+        }
+        fprintf(stderr, "%s: built\n", desc.Name);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc != 4)
+    {
+        fprintf(stderr, "Usage: patchc <game.exe> <plugin.ini> <output>\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> file;
+    SExeImage exe;
+    if (!ReadFile(argv[1], file) || !LoadExe(file, exe))
+    {
+        fprintf(stderr, "Cannot load %s as a 32-bit PE file\n", argv[1]);
+        return 1;
+    }
+
+    PluginConfig.Load(argv[2]);
+    if (!PluginConfig.Warnings.empty())
+    {
+        for (size_t i = 0; i < PluginConfig.Warnings.size(); i++)
+            fprintf(stderr, "%s: %s\n", argv[2], PluginConfig.Warnings[i].c_str());
+        return 1;
+    }
+
+    GameVersion = FindGameVersion(exe.Image);
+    fprintf(stderr, "Game build: %s\n", GameVersion != nullptr ? GameVersion->Name : "unknown");
+
+    PatchImage::CImageBuilder builder;
+    if (!BuildPatches(exe, builder))
+        return 1;
+
+    PatchImage::SImageStamp stamp = {exe.TimeStamp, (uint32_t)exe.Memory.size(),
+                                     PluginConfig.GetHash()};
+    std::vector<uint8_t> image;
+    builder.Write(stamp, image);
+
+    FILE *output = fopen(argv[3], "wb");
+    bool written = output != nullptr && fwrite(&image[0], 1, image.size(), output) == image.size();
+    if (output != nullptr)
+        written = fclose(output) == 0 && written;
+    if (!written)
+    {
+        fprintf(stderr, "Cannot write %s\n", argv[3]);
+        return 1;
+    }
+
+    fprintf(stderr, "%u patches, %u runs, %u bytes\n", (unsigned)builder.GetPatchCount(),
+            (unsigned)builder.GetRunCount(), (unsigned)image.size());
+    return 0;
+}
@@ -0,0 +1,112 @@
+//
+// Prints sections, imports, exports and relocations of a 32-bit PE file.
+//
+// It shows the ranges patches and hooks work with, e.g. where .text ends or
+// which IAT slot holds an imported function, without a Windows SDK.
+// Functions given after the file are looked up the same way as import hooks
+// of the plugin find their slots.
+//
+// Usage: peinfo <file.exe|file.dll> [module!function...]
+//
+
+#include "Shared/PeImage.h"
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+static bool ReadFile(const char *filename, std::vector<uint8_t> &result)
+{
+    FILE *file = fopen(filename, "rb");
+    if (file == nullptr)
+        return false;
+
+    bool ok = false;
+    long size;
+    if (fseek(file, 0, SEEK_END) != 0)
+        goto fail;
+    size = ftell(file);
+    if (size <= 0 || fseek(file, 0, SEEK_SET) != 0)
+        goto fail;
+    result.resize((size_t)size);
+    ok = fread(&result[0], 1, result.size(), file) == result.size();
+
+fail:
+    fclose(file);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: peinfo <file.exe|file.dll> [module!function...]\n");
+        return 1;
+    }
+
+    std::vector<uint8_t> file;
+    PeImage::CPeImage image;
+    if (!ReadFile(argv[1], file) || !image.Parse(&file[0], file.size(), false))
+    {
+        fprintf(stderr, "Cannot read %s as a 32-bit PE file\n", argv[1]);
+        return 1;
+    }
+
+    printf("Image base 0x%08X, size 0x%X, entry point 0x%X, time stamp 0x%08X\n",
+           image.GetImageBase(), image.GetImageSize(), image.GetEntryPoint(),
+           image.GetTimeStamp());
+
+    printf("\n%-8s %10s %10s %10s %10s %s\n", "Section", "RVA", "Size", "Raw offset", "Raw size",
+           "Flags");
+    const auto &sections = image.GetSections();
+    for (auto it = sections.cbegin(); it != sections.cend(); ++it)
+    {
+        printf("%-8s 0x%08X 0x%08X 0x%08X 0x%08X %c%c\n", it->Name, it->Rva, it->Size,
+               it->RawOffset, it->RawSize, it->IsExecutable() ? 'x' : '-',
+               (it->Characteristics & PeImage::SectionWrite) != 0 ? 'w' : '-');
+    }
+
+    std::vector<PeImage::SImport> imports;
+    if (!image.ReadImports(imports))
+        fprintf(stderr, "Import table is damaged\n");
+    std::map<std::string, size_t> modules;
+    for (auto it = imports.cbegin(); it != imports.cend(); ++it)
+        modules[it->Module]++;
+    printf("\n%u imports\n", (unsigned)imports.size());
+    for (auto it = modules.cbegin(); it != modules.cend(); ++it)
+        printf("  %-24s %u\n", it->first.c_str(), (unsigned)it->second);
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string module = argv[i];
+        size_t separator = module.find('!');
+        std::string function = separator != std::string::npos ? module.substr(separator + 1) : "";
+        module.resize(std::min(separator, module.size()));
+
+        std::vector<uint32_t> slots;
+        PeImage::FindImportSlots(imports, module.c_str(), function.c_str(), slots);
+        printf("  %s:", argv[i]);
+        if (slots.empty())
+            printf(" not imported");
+        for (auto it = slots.cbegin(); it != slots.cend(); ++it)
+            printf(" IAT slot 0x%08X", image.GetImageBase() + *it);
+        printf("\n");
+    }
+
+    std::vector<PeImage::SExport> exports;
+    if (!image.ReadExports(exports))
+        fprintf(stderr, "Export table is damaged\n");
+    printf("\n%u exports\n", (unsigned)exports.size());
+    for (auto it = exports.cbegin(); it != exports.cend(); ++it)
+    {
+        printf("  %5u 0x%08X %s%s%s\n", it->Ordinal, it->Rva, it->Name.c_str(),
+               it->Forwarder.empty() ? "" : " -> ", it->Forwarder.c_str());
+    }
+
+    std::vector<uint32_t> relocations;
+    if (!image.ReadRelocations(relocations))
+        fprintf(stderr, "Relocation table is damaged\n");
+    printf("\n%u relocations\n", (unsigned)relocations.size());
+    return 0;
+}
@@ -0,0 +1,155 @@
+//
+// Compares the pool allocator with the CRT heap on a game-like workload:
+// several threads allocate and free many small blocks of random sizes, with
+// a part of blocks living for a while before they are freed.
+//
+// Usage: poolbench [threads] [operations per thread]
+//
+
+#include "Shared/PoolAllocator.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <windows.h>
+
+static const size_t LiveBlocks = 4096; // Per thread
+
+struct SAllocator
+{
+    const char *Name;
+    void *(*Alloc)(size_t size);
+    void (*Free)(void *ptr);
+};
+
+static void *PoolAlloc(size_t size)
+{
+    return PoolAllocator::Alloc(size);
+}
+
+static void PoolFree(void *ptr)
+{
+    PoolAllocator::Free(ptr);
+}
+
+static void *CrtAlloc(size_t size)
+{
+    return malloc(size);
+}
+
+static void CrtFree(void *ptr)
+{
+    free(ptr);
+}
+
+struct SThreadArgs
+{
+    const SAllocator *Allocator;
+    size_t Operations;
+    uint32_t Seed;
+};
+
+static uint32_t NextRandom(uint32_t &state)
+{
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+// Most of game allocations are small strings and nodes of containers
+static size_t RandomSize(uint32_t &state)
+{
+    uint32_t r = NextRandom(state);
+    if (r % 16 < 12)
+        return 8 + r / 16 % 120;
+    return 128 + r / 16 % (PoolAllocator::MaxBlockSize - 128);
+}
+
+static DWORD WINAPI BenchThread(LPVOID param)
+{
+    auto args = (const SThreadArgs *)param;
+    std::vector<void *> live(LiveBlocks, nullptr);
+    uint32_t state = args->Seed;
+
+    for (size_t i = 0; i < args->Operations; i++)
+    {
+        void *&slot = live[NextRandom(state) % LiveBlocks];
+        if (slot != nullptr)
+            args->Allocator->Free(slot);
+        slot = args->Allocator->Alloc(RandomSize(state));
+        if (slot == nullptr)
+        {
+            fprintf(stderr, "%s: out of memory\n", args->Allocator->Name);
+            exit(1);
+        }
+        *(char *)slot = 1;
+    }
+    for (size_t i = 0; i < LiveBlocks; i++)
+    {
+        if (live[i] != nullptr)
+            args->Allocator->Free(live[i]);
+    }
+    return 0;
+}
+
+static double Run(const SAllocator &allocator, size_t threadCount, size_t operations)
+{
+    std::vector<SThreadArgs> args(threadCount);
+    std::vector<HANDLE> threads(threadCount);
+    LARGE_INTEGER freq, start, end;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&start);
+
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        args[i].Allocator = &allocator;
+        args[i].Operations = operations;
+        args[i].Seed = 2463534242u + (uint32_t)i * 7919;
+        threads[i] = CreateThread(NULL, 0, BenchThread, &args[i], 0, NULL);
+        if (threads[i] == NULL)
+        {
+            fprintf(stderr, "Cannot create a thread\n");
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < threadCount; i++)
+    {
+        WaitForSingleObject(threads[i], INFINITE);
+        CloseHandle(threads[i]);
+    }
+
+    QueryPerformanceCounter(&end);
+    return (double)(end.QuadPart - start.QuadPart) / freq.QuadPart;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t threadCount = argc > 1 ? strtoul(argv[1], nullptr, 0) : 4;
+    size_t operations = argc > 2 ? strtoul(argv[2], nullptr, 0) : 4000000;
+    if (threadCount == 0 || operations == 0)
+    {
+        fprintf(stderr, "Usage: poolbench [threads] [operations per thread]\n");
+        return 1;
+    }
+
+    if (!PoolAllocator::Init(256 * 1024 * 1024))
+    {
+        fprintf(stderr, "Cannot reserve memory for the pool\n");
+        return 1;
+    }
+
+    const SAllocator allocators[] = {
+        {"crt", CrtAlloc, CrtFree},
+        {"pool", PoolAlloc, PoolFree},
+    };
+
+    printf("%u threads, %u operations per thread\n", (unsigned)threadCount, (unsigned)operations);
+    for (size_t i = 0; i < _countof(allocators); i++)
+    {
+        double seconds = Run(allocators[i], threadCount, operations);
+        double total = (double)threadCount * operations;
+        printf("%-5s %8.3f s %8.1f ns/op\n", allocators[i].Name, seconds, seconds * 1e9 / total);
+    }
+    return 0;
+}
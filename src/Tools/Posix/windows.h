@@ -0,0 +1,274 @@
+#pragma once
+
+//
+// Minimal subset of Win32 API used by Shared code, implemented with POSIX
+// calls. It lets host tools and benchmarks build the hook, patch and pool
+// allocator code on Linux. Only what is actually called is implemented, other
+// declarations are here to compile Common.h.
+//
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Other targets have one calling convention
+#if defined(__i386__)
+#ifndef __stdcall
+#define __stdcall __attribute__((stdcall))
+#endif
+#ifndef __cdecl
+#define __cdecl __attribute__((cdecl))
+#endif
+#ifndef __fastcall
+#define __fastcall __attribute__((fastcall))
+#endif
+#else
+#define __stdcall
+#define __cdecl
+#define __fastcall
+#endif
+#define WINAPI __stdcall
+
+typedef int BOOL;
+typedef uint32_t DWORD;
+typedef int32_t LONG;
+typedef int64_t LONGLONG;
+typedef unsigned int UINT;
+typedef void *HANDLE;
+typedef void *HKEY;
+typedef void *LPVOID;
+typedef size_t SIZE_T;
+typedef DWORD(WINAPI *LPTHREAD_START_ROUTINE)(LPVOID param);
+
+typedef union
+{
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+// Recursive, as a critical section is
+typedef pthread_mutex_t CRITICAL_SECTION;
+
+#define TRUE 1
+#define FALSE 0
+
+#define CP_ACP 0
+#define INVALID_FILE_ATTRIBUTES ((DWORD)-1)
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+
+#define PAGE_NOACCESS 0x01
+#define PAGE_READONLY 0x02
+#define PAGE_READWRITE 0x04
+#define PAGE_EXECUTE_READ 0x20
+#define PAGE_EXECUTE_READWRITE 0x40
+
+#define MEM_COMMIT 0x1000
+#define MEM_RESERVE 0x2000
+#define MEM_RELEASE 0x8000
+
+#define HEAP_ZERO_MEMORY 0x08
+
+#define TLS_OUT_OF_INDEXES ((DWORD)0xFFFFFFFF)
+#define INFINITE 0xFFFFFFFF
+#define WAIT_OBJECT_0 0
+#define WAIT_FAILED ((DWORD)0xFFFFFFFF)
+
+#define _countof(array) (sizeof(array) / sizeof(array[0]))
+
+DWORD GetFileAttributesA(const char *filename);
+DWORD GetFileAttributesW(const wchar_t *filename);
+
+static inline DWORD GetLastError()
+{
+    return (DWORD)errno;
+}
+
+static inline void SetLastError(DWORD error)
+{
+    errno = (int)error;
+}
+
+static inline int PosixProtection(DWORD protect)
+{
+    switch (protect)
+    {
+    case PAGE_READONLY:
+        return PROT_READ;
+    case PAGE_READWRITE:
+        return PROT_READ | PROT_WRITE;
+    case PAGE_EXECUTE_READ:
+        return PROT_READ | PROT_EXEC;
+    case PAGE_EXECUTE_READWRITE:
+        return PROT_READ | PROT_WRITE | PROT_EXEC;
+    default:
+        return PROT_NONE;
+    }
+}
+
+// Reserved pages are mapped with no access, committing just changes protection
+static inline LPVOID VirtualAlloc(LPVOID addr, SIZE_T size, DWORD type, DWORD protect)
+{
+    int prot = type & MEM_COMMIT ? PosixProtection(protect) : PROT_NONE;
+    if (addr != NULL)
+        return mprotect(addr, size, prot) == 0 ? addr : NULL;
+
+    void *result = mmap(NULL, size, prot, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return result != MAP_FAILED ? result : NULL;
+}
+
+// The size of a mapping isn't known here, so releasing leaks the address space.
+// It only happens when a tool exits
+static inline BOOL VirtualFree(LPVOID, SIZE_T, DWORD)
+{
+    return TRUE;
+}
+
+// The old protection isn't tracked
+static inline BOOL VirtualProtect(LPVOID addr, SIZE_T size, DWORD protect, DWORD *oldProtect)
+{
+    // mprotect needs a page aligned address
+    uintptr_t page = (uintptr_t)sysconf(_SC_PAGESIZE);
+    uintptr_t start = (uintptr_t)addr & ~(page - 1);
+    size += (uintptr_t)addr - start;
+    if (oldProtect != NULL)
+        *oldProtect = PAGE_EXECUTE_READWRITE;
+    return mprotect((void *)start, size, PosixProtection(protect)) == 0;
+}
+
+static inline HANDLE GetCurrentProcess()
+{
+    return (HANDLE)-1;
+}
+
+// x86 keeps instruction cache coherent
+static inline BOOL FlushInstructionCache(HANDLE, const void *, SIZE_T)
+{
+    return TRUE;
+}
+
+static inline HANDLE GetProcessHeap()
+{
+    return (HANDLE)-1;
+}
+
+static inline LPVOID HeapAlloc(HANDLE, DWORD flags, SIZE_T size)
+{
+    return flags & HEAP_ZERO_MEMORY ? calloc(1, size) : malloc(size);
+}
+
+static inline DWORD TlsAlloc()
+{
+    pthread_key_t key;
+    return pthread_key_create(&key, NULL) == 0 ? (DWORD)key : TLS_OUT_OF_INDEXES;
+}
+
+static inline LPVOID TlsGetValue(DWORD index)
+{
+    return pthread_getspecific((pthread_key_t)index);
+}
+
+static inline BOOL TlsSetValue(DWORD index, LPVOID value)
+{
+    return pthread_setspecific((pthread_key_t)index, value) == 0;
+}
+
+static inline void InitializeCriticalSection(CRITICAL_SECTION *section)
+{
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(section, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+static inline void DeleteCriticalSection(CRITICAL_SECTION *section)
+{
+    pthread_mutex_destroy(section);
+}
+
+static inline void EnterCriticalSection(CRITICAL_SECTION *section)
+{
+    pthread_mutex_lock(section);
+}
+
+static inline void LeaveCriticalSection(CRITICAL_SECTION *section)
+{
+    pthread_mutex_unlock(section);
+}
+
+static inline LONG InterlockedIncrement(volatile LONG *value)
+{
+    return __sync_add_and_fetch(value, 1);
+}
+
+static inline LONG InterlockedExchange(volatile LONG *target, LONG value)
+{
+    return __sync_lock_test_and_set(target, value);
+}
+
+static inline void YieldProcessor()
+{
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Counts nanoseconds
+static inline BOOL QueryPerformanceCounter(LARGE_INTEGER *counter)
+{
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    counter->QuadPart = (LONGLONG)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    return TRUE;
+}
+
+static inline BOOL QueryPerformanceFrequency(LARGE_INTEGER *freq)
+{
+    freq->QuadPart = 1000000000;
+    return TRUE;
+}
+
+struct SPosixThread
+{
+    pthread_t Thread;
+    LPTHREAD_START_ROUTINE Routine;
+    LPVOID Param;
+};
+
+static inline void *PosixThreadStart(void *param)
+{
+    auto thread = (SPosixThread *)param;
+    thread->Routine(thread->Param);
+    return NULL;
+}
+
+// The handle can only be waited for with INFINITE timeout and closed
+static inline HANDLE CreateThread(void *, SIZE_T, LPTHREAD_START_ROUTINE routine, LPVOID param,
+                                  DWORD, DWORD *)
+{
+    auto thread = new SPosixThread;
+    thread->Routine = routine;
+    thread->Param = param;
+    if (pthread_create(&thread->Thread, NULL, PosixThreadStart, thread) != 0)
+    {
+        delete thread;
+        return NULL;
+    }
+    return thread;
+}
+
+static inline DWORD WaitForSingleObject(HANDLE handle, DWORD)
+{
+    auto thread = (SPosixThread *)handle;
+    return pthread_join(thread->Thread, NULL) == 0 ? WAIT_OBJECT_0 : WAIT_FAILED;
+}
+
+static inline BOOL CloseHandle(HANDLE handle)
+{
+    delete (SPosixThread *)handle;
+    return TRUE;
+}
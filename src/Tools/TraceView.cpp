@@ -0,0 +1,474 @@
+//
+// Offline analyzer for hook traces written by Trace::Start (see TraceFormat.h).
+//
+// The trace is scanned once through a sliding file mapping, so memory usage
+// doesn't depend on the trace size. Prints per-hook event counts and call
+// duration percentiles, and optionally writes flamegraph-compatible folded
+// stacks built from EK_ENTER/EK_EXIT pairs.
+//
+
+#include "Shared/Histogram.h"
+#include "Shared/TraceFormat.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace Trace;
+
+static const uint64_t WindowSize = 64 * 1024 * 1024;
+
+class CMappedFile
+{
+public:
+    CMappedFile()
+        : _size(0)
+        , _view(nullptr)
+        , _viewSize(0)
+        , _granularity(4096)
+#ifdef _WIN32
+        , _file(INVALID_HANDLE_VALUE)
+        , _mapping(NULL)
+#else
+        , _fd(-1)
+#endif
+    {
+    }
+
+    ~CMappedFile()
+    {
+        Unmap();
+#ifdef _WIN32
+        if (_mapping != NULL)
+            CloseHandle(_mapping);
+        if (_file != INVALID_HANDLE_VALUE)
+            CloseHandle(_file);
+#else
+        if (_fd >= 0)
+            close(_fd);
+#endif
+    }
+
+    bool Open(const char *filename)
+    {
+#ifdef _WIN32
+        _file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL,
+                            OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (_file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size;
+        if (!GetFileSizeEx(_file, &size))
+            return false;
+        _size = size.QuadPart;
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        _granularity = info.dwAllocationGranularity;
+        if (_size == 0)
+            return true;
+        _mapping = CreateFileMappingA(_file, NULL, PAGE_READONLY, 0, 0, NULL);
+        return _mapping != NULL;
+#else
+        _fd = open(filename, O_RDONLY);
+        if (_fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(_fd, &st) != 0)
+            return false;
+        _size = st.st_size;
+        _granularity = sysconf(_SC_PAGESIZE);
+        return true;
+#endif
+    }
+
+    uint64_t GetSize() const { return _size; }
+
+    // Maps at least the specified range and returns a pointer to its start
+    const char *Map(uint64_t offset, uint64_t size)
+    {
+        Unmap();
+        uint64_t start = offset - offset % _granularity;
+        _viewSize = (size_t)(offset + size - start);
+#ifdef _WIN32
+        _view = (char *)MapViewOfFile(_mapping, FILE_MAP_READ, (DWORD)(start >> 32), (DWORD)start,
+                                      _viewSize);
+#else
+        void *view = mmap(nullptr, _viewSize, PROT_READ, MAP_PRIVATE, _fd, (off_t)start);
+        _view = view != MAP_FAILED ? (char *)view : nullptr;
+        if (_view != nullptr)
+            madvise(_view, _viewSize, MADV_SEQUENTIAL);
+#endif
+        return _view != nullptr ? _view + (offset - start) : nullptr;
+    }
+
+private:
+    uint64_t _size;
+    char *_view;
+    size_t _viewSize;
+    uint64_t _granularity;
+#ifdef _WIN32
+    HANDLE _file;
+    HANDLE _mapping;
+#else
+    int _fd;
+#endif
+
+    void Unmap()
+    {
+        if (_view == nullptr)
+            return;
+#ifdef _WIN32
+        UnmapViewOfFile(_view);
+#else
+        munmap(_view, _viewSize);
+#endif
+        _view = nullptr;
+    }
+};
+
+struct SHookStats
+{
+    uint64_t Events;
+    uint64_t Calls;
+    Stats::SHistogram Durations;
+
+    SHookStats()
+        : Events(0)
+        , Calls(0)
+    {
+    }
+};
+
+// Call stacks are stored as a tree, so each exit costs a hash lookup instead
+// of building a stack string
+struct SStackNode
+{
+    uint32_t Parent;
+    uint16_t HookId;
+    uint64_t SelfTicks;
+};
+
+struct SFrame
+{
+    uint32_t Node;
+    uint16_t HookId;
+    uint64_t EnterTicks;
+    uint64_t ChildTicks;
+};
+
+class CAnalyzer
+{
+public:
+    CAnalyzer()
+        : _dropped(0)
+        , _unmatched(0)
+        , _firstTicks(UINT64_MAX)
+        , _lastTicks(0)
+        , _lastThreadId(0)
+        , _lastStack(nullptr)
+        , _hooks(UINT16_MAX + 1)
+    {
+        // Root node
+        SStackNode root = { 0, 0, 0 };
+        _nodes.push_back(root);
+    }
+
+    void Process(const STraceEvent &ev)
+    {
+        // Events are drained ring by ring, so they aren't ordered by time across threads
+        _firstTicks = std::min(_firstTicks, ev.Ticks);
+        _lastTicks = std::max(_lastTicks, ev.Ticks);
+
+        if (ev.Kind == EK_DROPPED)
+        {
+            _dropped += ev.Args[0];
+            return;
+        }
+
+        SHookStats &stats = GetHookStats(ev.HookId);
+        stats.Events++;
+        if (ev.Kind == EK_ENTER)
+        {
+            auto &stack = GetStack(ev.ThreadId);
+            SFrame frame;
+            frame.Node = GetChildNode(stack.empty() ? 0 : stack.back().Node, ev.HookId);
+            frame.HookId = ev.HookId;
+            frame.EnterTicks = ev.Ticks;
+            frame.ChildTicks = 0;
+            stack.push_back(frame);
+        }
+        else if (ev.Kind == EK_EXIT)
+        {
+            auto &stack = GetStack(ev.ThreadId);
+            // Frames skipped by an exception are unwound up to the matching one
+            size_t depth = stack.size();
+            while (depth > 0 && stack[depth - 1].HookId != ev.HookId)
+                depth--;
+            if (depth == 0)
+            {
+                _unmatched++;
+                return;
+            }
+            stack.resize(depth);
+
+            SFrame &frame = stack.back();
+            uint64_t duration = ev.Ticks - frame.EnterTicks;
+            stats.Calls++;
+            stats.Durations.Record(duration);
+            _nodes[frame.Node].SelfTicks += duration - std::min(duration, frame.ChildTicks);
+            stack.pop_back();
+            if (!stack.empty())
+                stack.back().ChildTicks += duration;
+        }
+    }
+
+    void SetName(uint16_t hookId, const std::string &name) { _names[hookId] = name; }
+
+    void PrintSummary(FILE *out, const STraceHeader &header, uint64_t eventCount) const
+    {
+        double ticksPerUs = header.TicksPerSecond != 0 ? header.TicksPerSecond / 1e6 : 1.0;
+        const char *unit = header.TicksPerSecond != 0 ? "us" : "ticks";
+
+        fprintf(out, "Events: %llu, dropped: %llu, unmatched exits: %llu\n",
+                (unsigned long long)eventCount, (unsigned long long)_dropped,
+                (unsigned long long)_unmatched);
+        if (header.TicksPerSecond != 0 && _lastTicks >= _firstTicks)
+            fprintf(out, "Duration: %.3f s\n", (_lastTicks - _firstTicks) / ticksPerUs / 1e6);
+        fprintf(out, "\n%-6s %-32s %12s %12s %10s %10s %10s %10s %10s (%s)\n", "Id", "Name",
+                "Events", "Calls", "Mean", "p50", "p90", "p99", "Max", unit);
+
+        for (size_t id = 0; id < _hooks.size(); id++)
+        {
+            if (!_hooks[id])
+                continue;
+            const SHookStats &stats = *_hooks[id];
+            const Stats::SHistogram &h = stats.Durations;
+            fprintf(out, "%-6u %-32s %12llu %12llu %10.2f %10.2f %10.2f %10.2f %10.2f\n",
+                    (unsigned)id, GetName((uint16_t)id).c_str(), (unsigned long long)stats.Events,
+                    (unsigned long long)stats.Calls, h.GetMean() / ticksPerUs,
+                    h.GetPercentile(50) / ticksPerUs, h.GetPercentile(90) / ticksPerUs,
+                    h.GetPercentile(99) / ticksPerUs, h.Max / ticksPerUs);
+        }
+    }
+
+    // Writes "root;child;grandchild self_time" lines (flamegraph.pl format)
+    void WriteFolded(FILE *out, const STraceHeader &header) const
+    {
+        double ticksPerUs = header.TicksPerSecond != 0 ? header.TicksPerSecond / 1e6 : 1.0;
+        std::vector<uint16_t> path;
+        for (size_t i = 1; i < _nodes.size(); i++)
+        {
+            auto value = (unsigned long long)(_nodes[i].SelfTicks / ticksPerUs);
+            if (value == 0)
+                continue;
+
+            path.clear();
+            for (uint32_t n = (uint32_t)i; n != 0; n = _nodes[n].Parent)
+                path.push_back(_nodes[n].HookId);
+
+            std::string line;
+            for (auto it = path.crbegin(); it != path.crend(); ++it)
+            {
+                if (!line.empty())
+                    line += ';';
+                line += GetName(*it);
+            }
+            fprintf(out, "%s %llu\n", line.c_str(), value);
+        }
+    }
+
+private:
+    uint64_t _dropped;
+    uint64_t _unmatched;
+    uint64_t _firstTicks;
+    uint64_t _lastTicks;
+    uint32_t _lastThreadId;
+    std::vector<SFrame> *_lastStack;
+    std::vector<std::unique_ptr<SHookStats>> _hooks;
+    std::map<uint16_t, std::string> _names;
+    std::unordered_map<uint32_t, std::vector<SFrame>> _stacks;
+    std::unordered_map<uint64_t, uint32_t> _children;
+    std::vector<SStackNode> _nodes;
+
+    SHookStats &GetHookStats(uint16_t hookId)
+    {
+        auto &stats = _hooks[hookId];
+        if (!stats)
+            stats.reset(new SHookStats);
+        return *stats;
+    }
+
+    std::vector<SFrame> &GetStack(uint32_t threadId)
+    {
+        // Events of one thread usually come in long runs
+        if (_lastStack == nullptr || threadId != _lastThreadId)
+        {
+            _lastStack = &_stacks[threadId];
+            _lastThreadId = threadId;
+        }
+        return *_lastStack;
+    }
+
+    uint32_t GetChildNode(uint32_t parent, uint16_t hookId)
+    {
+        uint64_t key = (uint64_t)parent << 16 | hookId;
+        auto it = _children.find(key);
+        if (it != _children.end())
+            return it->second;
+
+        SStackNode node = { parent, hookId, 0 };
+        _nodes.push_back(node);
+        auto index = (uint32_t)(_nodes.size() - 1);
+        _children[key] = index;
+        return index;
+    }
+
+    std::string GetName(uint16_t hookId) const
+    {
+        auto it = _names.find(hookId);
+        if (it != _names.end())
+            return it->second;
+        char buf[32];
+        snprintf(buf, sizeof(buf), "hook_%u", (unsigned)hookId);
+        return buf;
+    }
+};
+
+static void Usage()
+{
+    fprintf(stderr, "Usage: traceview [--folded <file>] <trace file>\n"
+                    "\n"
+                    "Prints per-hook statistics of the trace file.\n"
+                    "  --folded <file>   Write folded stacks for flamegraph.pl ('-' for stdout)\n");
+}
+
+static bool ReadNames(CMappedFile &file, const STraceHeader &header, CAnalyzer &analyzer)
+{
+    if (header.NameCount == 0)
+        return true;
+    if (header.NamesOffset >= file.GetSize())
+        return false;
+
+    uint64_t size = file.GetSize() - header.NamesOffset;
+    const char *data = file.Map(header.NamesOffset, size);
+    if (data == nullptr)
+        return false;
+
+    const char *end = data + size;
+    for (uint32_t i = 0; i < header.NameCount; i++)
+    {
+        STraceName name;
+        if (end - data < (ptrdiff_t)sizeof(name))
+            return false;
+        memcpy(&name, data, sizeof(name));
+        data += sizeof(name);
+        if (end - data < name.Length)
+            return false;
+        analyzer.SetName(name.HookId, std::string(data, name.Length));
+        data += name.Length;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const char *foldedPath = nullptr;
+    const char *tracePath = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--folded") == 0 && i + 1 < argc)
+            foldedPath = argv[++i];
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+            return Usage(), 1;
+        else
+            tracePath = argv[i];
+    }
+    if (tracePath == nullptr)
+        return Usage(), 1;
+
+    CMappedFile file;
+    if (!file.Open(tracePath))
+    {
+        fprintf(stderr, "Cannot open %s\n", tracePath);
+        return 1;
+    }
+
+    STraceHeader header;
+    const char *data = file.GetSize() >= sizeof(header) ? file.Map(0, sizeof(header)) : nullptr;
+    if (data == nullptr)
+    {
+        fprintf(stderr, "Cannot read trace header\n");
+        return 1;
+    }
+    memcpy(&header, data, sizeof(header));
+    if (header.Magic != FileMagic || header.Version != FileVersion ||
+        header.EventSize != sizeof(STraceEvent))
+    {
+        fprintf(stderr, "Unsupported trace file format\n");
+        return 1;
+    }
+    if (header.NamesOffset != 0 &&
+        (header.NamesOffset < sizeof(header) || header.NamesOffset > file.GetSize()))
+    {
+        fprintf(stderr, "Trace header is damaged\n");
+        return 1;
+    }
+
+    // The trailer is missing if the process has crashed
+    uint64_t eventsEnd = header.NamesOffset != 0 ? header.NamesOffset : file.GetSize();
+    uint64_t eventCount = (eventsEnd - sizeof(header)) / sizeof(STraceEvent);
+    eventsEnd = sizeof(header) + eventCount * sizeof(STraceEvent);
+
+    CAnalyzer analyzer;
+    if (!ReadNames(file, header, analyzer))
+        fprintf(stderr, "Warning: hook names table is damaged\n");
+
+    for (uint64_t offset = sizeof(header); offset < eventsEnd;)
+    {
+        uint64_t size = std::min(WindowSize, eventsEnd - offset);
+        size -= size % sizeof(STraceEvent);
+        data = file.Map(offset, size);
+        if (data == nullptr)
+        {
+            fprintf(stderr, "Cannot map trace file at offset %llu\n", (unsigned long long)offset);
+            return 1;
+        }
+
+        for (const char *p = data; p < data + size; p += sizeof(STraceEvent))
+        {
+            STraceEvent ev;
+            memcpy(&ev, p, sizeof(ev));
+            analyzer.Process(ev);
+        }
+        offset += size;
+    }
+
+    bool foldedToStdout = foldedPath != nullptr && strcmp(foldedPath, "-") == 0;
+    analyzer.PrintSummary(foldedToStdout ? stderr : stdout, header, eventCount);
+
+    if (foldedPath != nullptr)
+    {
+        FILE *out = foldedToStdout ? stdout : fopen(foldedPath, "w");
+        if (out == nullptr)
+        {
+            fprintf(stderr, "Cannot create %s\n", foldedPath);
+            return 1;
+        }
+        analyzer.WriteFolded(out, header);
+        if (!foldedToStdout)
+            fclose(out);
+    }
+    return 0;
+}